@@ -0,0 +1,379 @@
+/*!
+ * \file allocator.hpp
+ * \brief Contains arena and size-class pool allocators for use with BasicBuffer
+ * \author Jari Ronkainen
+ * \version 1.0
+ *
+ * MonotonicArena hands out memory by bumping a pointer and never frees individual
+ * allocations, everything allocated from it is released at once with reset().  This is
+ * meant for per-frame or per-message scratch buffers.
+ *
+ * SizeClassPool keeps freed blocks in free lists by power-of-two size classes and
+ * reuses them for later allocations of the same class.
+ *
+ * Neither is thread-safe, the intended use is one arena or pool per thread, which also
+ * means threads do not contend on the global heap for these allocations.
+ *
+ *  mush::MonotonicArena arena;
+ *  mush::ArenaBuffer buf(arena);
+ *  ...
+ *  arena.reset();
+ */
+
+#ifndef MUSH_ALLOCATOR
+#define MUSH_ALLOCATOR
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+#include "buffer.hpp"
+
+namespace mush
+{
+    /**
+     * @brief Bump-pointer arena, individual allocations are never freed
+     */
+    class MonotonicArena
+    {
+        public:
+            constexpr static size_t DEFAULT_BLOCK_SIZE = 64 * 1024;
+
+            explicit MonotonicArena(size_t block_size = DEFAULT_BLOCK_SIZE) noexcept;
+           ~MonotonicArena();
+
+            MonotonicArena(const MonotonicArena&) = delete;
+            MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+            void*           allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+
+            void            reset() noexcept;
+            void            release() noexcept;
+
+            size_t          used() const noexcept;
+            size_t          reserved() const noexcept;
+
+        private:
+            struct Block
+            {
+                Block*      next;
+                size_t      size;
+            };
+
+            constexpr static size_t HEADER_SIZE = (sizeof(Block) + alignof(std::max_align_t) - 1)
+                                                & ~(alignof(std::max_align_t) - 1);
+
+            uint8_t*        block_begin(Block* block) const noexcept;
+            bool            enter(Block* block, size_t bytes, size_t alignment) noexcept;
+
+            Block*          first = nullptr;
+            Block*          current = nullptr;
+            uint8_t*        cursor = nullptr;
+            uint8_t*        limit = nullptr;
+
+            size_t          block_size;
+            size_t          used_bytes = 0;
+            size_t          reserved_bytes = 0;
+    };
+
+    /**
+     * @brief Free lists of power-of-two size classes
+     */
+    class SizeClassPool
+    {
+        public:
+            constexpr static size_t MIN_CLASS_LOG = 4;
+            constexpr static size_t MAX_CLASS_LOG = 20;
+
+            SizeClassPool() noexcept = default;
+           ~SizeClassPool();
+
+            SizeClassPool(const SizeClassPool&) = delete;
+            SizeClassPool& operator=(const SizeClassPool&) = delete;
+
+            void*           allocate(size_t bytes);
+            void            deallocate(void* ptr, size_t bytes) noexcept;
+
+            void            release() noexcept;
+
+        private:
+            struct Node { Node* next; };
+
+            constexpr static size_t CLASS_COUNT = MAX_CLASS_LOG - MIN_CLASS_LOG + 1;
+
+            static size_t   size_class(size_t bytes) noexcept;
+
+            Node*           free_lists[CLASS_COUNT] = {};
+    };
+
+    //! std-compatible allocator drawing from a MonotonicArena
+    template <typename T>
+    class ArenaAllocator
+    {
+        public:
+            typedef T value_type;
+
+            ArenaAllocator(MonotonicArena& arena) noexcept : arena(&arena) {}
+
+            template <typename U>
+            ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+            T* allocate(size_t n)
+            {
+                return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+            }
+
+            void deallocate(T*, size_t) noexcept {}
+
+            template <typename U> bool operator==(const ArenaAllocator<U>& rhs) const noexcept { return arena == rhs.arena; }
+            template <typename U> bool operator!=(const ArenaAllocator<U>& rhs) const noexcept { return arena != rhs.arena; }
+
+        private:
+            template <typename U> friend class ArenaAllocator;
+
+            MonotonicArena* arena;
+    };
+
+    //! std-compatible allocator drawing from a SizeClassPool
+    template <typename T>
+    class PoolAllocator
+    {
+        public:
+            typedef T value_type;
+
+            PoolAllocator(SizeClassPool& pool) noexcept : pool(&pool) {}
+
+            template <typename U>
+            PoolAllocator(const PoolAllocator<U>& other) noexcept : pool(other.pool) {}
+
+            T* allocate(size_t n)
+            {
+                return static_cast<T*>(pool->allocate(n * sizeof(T)));
+            }
+
+            void deallocate(T* ptr, size_t n) noexcept
+            {
+                pool->deallocate(ptr, n * sizeof(T));
+            }
+
+            template <typename U> bool operator==(const PoolAllocator<U>& rhs) const noexcept { return pool == rhs.pool; }
+            template <typename U> bool operator!=(const PoolAllocator<U>& rhs) const noexcept { return pool != rhs.pool; }
+
+        private:
+            template <typename U> friend class PoolAllocator;
+
+            SizeClassPool*  pool;
+    };
+
+    // The allocators have no default state, so these buffers have no default constructor
+    // and are made from the arena or pool they draw from:  ArenaBuffer buf(arena);
+    using ArenaBuffer = BasicBuffer<ArenaAllocator<uint8_t>>;
+    using PoolBuffer = BasicBuffer<PoolAllocator<uint8_t>>;
+
+    // IMPLEMENTATIONS
+
+    inline MonotonicArena::MonotonicArena(size_t block_size) noexcept
+        : block_size(block_size) {}
+
+    inline MonotonicArena::~MonotonicArena()
+    {
+        release();
+    }
+
+    inline uint8_t* MonotonicArena::block_begin(Block* block) const noexcept
+    {
+        return reinterpret_cast<uint8_t*>(block) + HEADER_SIZE;
+    }
+
+    // make block the current block if the allocation fits into it
+    inline bool MonotonicArena::enter(Block* block, size_t bytes, size_t alignment) noexcept
+    {
+        uintptr_t start = reinterpret_cast<uintptr_t>(block_begin(block));
+        uintptr_t aligned = (start + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+        if (aligned - start + bytes > block->size)
+            return false;
+
+        current = block;
+        cursor = block_begin(block);
+        limit = cursor + block->size;
+
+        return true;
+    }
+
+    /**
+     * @brief Allocate memory from the arena
+     *
+     * @param bytes         number of bytes
+     * @param alignment     required alignment, must be a power of two
+     *
+     * @return pointer to the memory, valid until reset() or release()
+     */
+    inline void* MonotonicArena::allocate(size_t bytes, size_t alignment)
+    {
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+
+        if (cursor == nullptr || aligned + bytes > reinterpret_cast<uintptr_t>(limit))
+        {
+            // move on to the next already reserved block, or reserve a new one
+            Block* next = current ? current->next : first;
+            while (next != nullptr && !enter(next, bytes, alignment))
+                next = next->next;
+
+            if (next == nullptr)
+            {
+                size_t size = bytes + alignment > block_size ? bytes + alignment : block_size;
+                Block* block = static_cast<Block*>(::operator new(HEADER_SIZE + size));
+                block->size = size;
+
+                // keep the chain in order so reset() can walk it from the start
+                if (current != nullptr)
+                {
+                    block->next = current->next;
+                    current->next = block;
+                } else {
+                    block->next = first;
+                    first = block;
+                }
+
+                reserved_bytes += size;
+                enter(block, bytes, alignment);
+            }
+
+            aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+        }
+
+        cursor = reinterpret_cast<uint8_t*>(aligned + bytes);
+        used_bytes += bytes;
+
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    //! forget all allocations but keep the memory for reuse
+    inline void MonotonicArena::reset() noexcept
+    {
+        current = nullptr;
+        cursor = nullptr;
+        limit = nullptr;
+        used_bytes = 0;
+    }
+
+    //! forget all allocations and give the memory back to the system
+    inline void MonotonicArena::release() noexcept
+    {
+        while (first != nullptr)
+        {
+            Block* next = first->next;
+            ::operator delete(first);
+            first = next;
+        }
+
+        reset();
+        reserved_bytes = 0;
+    }
+
+    //! bytes allocated since last reset
+    inline size_t MonotonicArena::used() const noexcept { return used_bytes; }
+
+    //! bytes reserved from the system
+    inline size_t MonotonicArena::reserved() const noexcept { return reserved_bytes; }
+
+    inline SizeClassPool::~SizeClassPool()
+    {
+        release();
+    }
+
+    // index of the smallest class that fits bytes, CLASS_COUNT if none does
+    inline size_t SizeClassPool::size_class(size_t bytes) noexcept
+    {
+        size_t index = 0;
+        size_t class_size = size_t(1) << MIN_CLASS_LOG;
+
+        while (class_size < bytes && index < CLASS_COUNT)
+        {
+            class_size <<= 1;
+            ++index;
+        }
+
+        return index;
+    }
+
+    /**
+     * @brief Allocate memory from the pool
+     *
+     * Sizes are rounded up to the next power of two, allocations larger than the
+     * largest size class go directly to the global heap.
+     */
+    inline void* SizeClassPool::allocate(size_t bytes)
+    {
+        size_t index = size_class(bytes);
+
+        if (index == CLASS_COUNT)
+            return ::operator new(bytes);
+
+        if (free_lists[index] != nullptr)
+        {
+            Node* node = free_lists[index];
+            free_lists[index] = node->next;
+            return node;
+        }
+
+        return ::operator new(size_t(1) << (index + MIN_CLASS_LOG));
+    }
+
+    //! return memory to the pool, bytes must be the size it was allocated with
+    inline void SizeClassPool::deallocate(void* ptr, size_t bytes) noexcept
+    {
+        if (ptr == nullptr)
+            return;
+
+        size_t index = size_class(bytes);
+
+        if (index == CLASS_COUNT)
+        {
+            ::operator delete(ptr);
+            return;
+        }
+
+        Node* node = static_cast<Node*>(ptr);
+        node->next = free_lists[index];
+        free_lists[index] = node;
+    }
+
+    //! give all pooled memory back to the system
+    inline void SizeClassPool::release() noexcept
+    {
+        for (Node*& list : free_lists)
+        {
+            while (list != nullptr)
+            {
+                Node* next = list->next;
+                ::operator delete(list);
+                list = next;
+            }
+        }
+    }
+}
+
+#endif
+/*
+ Copyright (c) 2017 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,555 @@
+/*!
+ * \file async_io.hpp
+ * \brief Contains the AsyncIO service for reading and writing Buffers in the background
+ * \author Jari Ronkainen
+ * \version 1.0
+ *
+ * AsyncIO runs file reads, writes and syncs on worker threads with pread/pwritev/fsync,
+ * so the calling thread never waits for the disk.  Each operation either returns a
+ * future or calls a callback on the worker thread when it is done.
+ *
+ * All operations on the same file descriptor go to the same worker and are run in the
+ * order they were submitted, so a sync always covers the writes submitted before it.
+ * Callbacks run on the worker thread and must be noexcept, an exception there would
+ * have nowhere to go, so this is checked at compile time.
+ * While an operation runs, more requests can queue up behind it:
+ *  - consecutive writes to adjacent ranges of the same descriptor are merged into a
+ *    single pwritev
+ *  - consecutive syncs of the same descriptor are merged into a single fsync
+ *
+ *  mush::AsyncIO io;
+ *  io.write(fd, 0, std::move(header));
+ *  io.write(fd, header_size, std::move(body));
+ *  std::future<void> done = io.sync(fd);
+ *
+ * Requires a POSIX system.  The workers use plain blocking system calls, an io_uring
+ * backend could replace them behind the same interface.
+ */
+
+#ifndef MUSH_ASYNC_IO
+#define MUSH_ASYNC_IO
+
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+#include <system_error>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <new>
+#include <type_traits>
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "buffer.hpp"
+
+namespace mush
+{
+    /**
+     * @brief Background file IO service
+     */
+    class AsyncIO
+    {
+        public:
+            typedef std::function<void(Buffer&& data, int error)>   read_callback;
+            typedef std::function<void(size_t written, int error)>  write_callback;
+            typedef std::function<void(int error)>                  sync_callback;
+
+            //! writes are merged until the merged write would exceed this many bytes
+            constexpr static size_t MAX_BATCH_BYTES = 1 << 20;
+
+            //! at most this many writes are merged into one
+            constexpr static size_t MAX_BATCH_COUNT = 64;
+
+            AsyncIO(size_t thread_count = 2);
+           ~AsyncIO();
+
+            AsyncIO(const AsyncIO&) = delete;
+            AsyncIO& operator=(const AsyncIO&) = delete;
+
+            size_t              size() const noexcept;
+
+            template <typename Callback>
+            void                read(int fd, uint64_t offset, size_t len, Callback&& callback);
+            std::future<Buffer> read(int fd, uint64_t offset, size_t len);
+
+            template <typename Callback>
+            void                read_file(const char* filename, Callback&& callback);
+            std::future<Buffer> read_file(const char* filename);
+
+            template <typename Callback>
+            void                write(int fd, uint64_t offset, Buffer&& data, Callback&& callback);
+            std::future<size_t> write(int fd, uint64_t offset, Buffer&& data);
+
+            template <typename Callback>
+            void                sync(int fd, Callback&& callback);
+            std::future<void>   sync(int fd);
+
+        private:
+            struct Request
+            {
+                enum class Type { read, read_file, write, sync };
+
+                Type                type;
+                int                 fd;
+                uint64_t            offset;
+                size_t              length;
+                Buffer              data;
+                std::string         filename;
+
+                read_callback       on_read;
+                write_callback      on_write;
+                sync_callback       on_sync;
+            };
+
+            struct Worker
+            {
+                std::thread             thread;
+                std::mutex              mutex;
+                std::condition_variable condition;
+                std::deque<Request>     queue;
+                bool                    stop = false;
+            };
+
+            void                submit(size_t worker, Request&& request);
+            size_t              worker_for(int fd) const noexcept;
+            void                run(Worker& worker);
+
+            static void         do_read(Request& request);
+            static void         do_read_file(Request& request);
+            static void         do_write(std::deque<Request>& batch);
+            static void         do_sync(std::deque<Request>& batch);
+
+            std::vector<std::unique_ptr<Worker>>    workers;
+            std::atomic<size_t>                     next_worker = 0;
+    };
+
+    // IMPLEMENTATIONS
+
+    namespace detail
+    {
+        template <typename T>
+        inline void fail_promise(std::promise<T>& promise, int error)
+        {
+            promise.set_exception(std::make_exception_ptr(std::system_error(error, std::generic_category())));
+        }
+    }
+
+    /**
+     * @brief Start the worker threads
+     *
+     * @param thread_count  number of worker threads, each file descriptor is always
+     *                      handled by the same one
+     */
+    inline AsyncIO::AsyncIO(size_t thread_count)
+    {
+        if (thread_count == 0)
+            thread_count = 1;
+
+        for (size_t i = 0; i < thread_count; ++i)
+        {
+            workers.emplace_back(new Worker);
+            Worker& worker = *workers.back();
+            worker.thread = std::thread([this, &worker]{ run(worker); });
+        }
+    }
+
+    //! finishes all submitted operations before returning
+    inline AsyncIO::~AsyncIO()
+    {
+        for (auto& worker : workers)
+        {
+            {
+                std::unique_lock<std::mutex> lock(worker->mutex);
+                worker->stop = true;
+            }
+            worker->condition.notify_all();
+        }
+
+        for (auto& worker : workers)
+            worker->thread.join();
+    }
+
+    inline size_t AsyncIO::size() const noexcept
+    {
+        return workers.size();
+    }
+
+    inline size_t AsyncIO::worker_for(int fd) const noexcept
+    {
+        return static_cast<size_t>(fd) % workers.size();
+    }
+
+    inline void AsyncIO::submit(size_t index, Request&& request)
+    {
+        Worker& worker = *workers[index];
+        {
+            std::unique_lock<std::mutex> lock(worker.mutex);
+            worker.queue.push_back(std::move(request));
+        }
+        worker.condition.notify_one();
+    }
+
+    // worker thread, takes the next request and everything that can be merged with it
+    inline void AsyncIO::run(Worker& worker)
+    {
+        while (true)
+        {
+            std::deque<Request> batch;
+            {
+                std::unique_lock<std::mutex> lock(worker.mutex);
+                worker.condition.wait(lock, [&]{ return worker.stop || !worker.queue.empty(); });
+
+                if (worker.queue.empty())
+                    return;
+
+                batch.push_back(std::move(worker.queue.front()));
+                worker.queue.pop_front();
+
+                const Request& first = batch.front();
+                size_t batch_bytes = first.data.size();
+                uint64_t batch_end = first.offset + first.data.size();
+
+                while (!worker.queue.empty())
+                {
+                    const Request& next = worker.queue.front();
+
+                    if (next.type != first.type || next.fd != first.fd)
+                        break;
+
+                    if (first.type == Request::Type::write)
+                    {
+                        if (next.offset != batch_end
+                         || batch_bytes + next.data.size() > MAX_BATCH_BYTES
+                         || batch.size() == MAX_BATCH_COUNT)
+                            break;
+
+                        batch_bytes += next.data.size();
+                        batch_end += next.data.size();
+                    }
+                    else if (first.type != Request::Type::sync)
+                    {
+                        break;
+                    }
+
+                    batch.push_back(std::move(worker.queue.front()));
+                    worker.queue.pop_front();
+                }
+            }
+
+            switch (batch.front().type)
+            {
+                case Request::Type::read:       do_read(batch.front()); break;
+                case Request::Type::read_file:  do_read_file(batch.front()); break;
+                case Request::Type::write:      do_write(batch); break;
+                case Request::Type::sync:       do_sync(batch); break;
+            }
+        }
+    }
+
+    inline void AsyncIO::do_read(Request& request)
+    {
+        // nothing above the worker to catch a failed allocation, report it instead
+        Buffer data;
+        try
+        {
+            data.resize_uninitialized(request.length);
+        }
+        catch (const std::bad_alloc&)
+        {
+            request.on_read(Buffer(), ENOMEM);
+            return;
+        }
+
+        size_t done = 0;
+        while (done < request.length)
+        {
+            ssize_t got = ::pread(request.fd, data.data() + done, request.length - done, request.offset + done);
+
+            if (got < 0 && errno == EINTR)
+                continue;
+
+            if (got < 0)
+            {
+                request.on_read(Buffer(), errno);
+                return;
+            }
+
+            if (got == 0)
+                break;
+
+            done += got;
+        }
+
+        data.resize(done);
+        request.on_read(std::move(data), 0);
+    }
+
+    inline void AsyncIO::do_read_file(Request& request)
+    {
+        request.fd = ::open(request.filename.c_str(), O_RDONLY);
+        if (request.fd < 0)
+        {
+            request.on_read(Buffer(), errno);
+            return;
+        }
+
+        struct stat info;
+        if (::fstat(request.fd, &info) != 0)
+        {
+            int error = errno;
+            ::close(request.fd);
+            request.on_read(Buffer(), error);
+            return;
+        }
+
+        request.offset = 0;
+        request.length = static_cast<size_t>(info.st_size);
+        do_read(request);
+
+        ::close(request.fd);
+    }
+
+    // writes all the requests of the batch, they cover one contiguous range
+    inline void AsyncIO::do_write(std::deque<Request>& batch)
+    {
+        struct iovec iov[MAX_BATCH_COUNT];
+        size_t count = 0;
+        size_t total = 0;
+
+        for (Request& request : batch)
+        {
+            iov[count].iov_base = request.data.data();
+            iov[count].iov_len = request.data.size();
+            total += request.data.size();
+            ++count;
+        }
+
+        struct iovec* pending = iov;
+        uint64_t offset = batch.front().offset;
+        size_t done = 0;
+        int error = 0;
+
+        while (done < total)
+        {
+            ssize_t written = ::pwritev(batch.front().fd, pending, static_cast<int>(count), offset + done);
+
+            if (written < 0 && errno == EINTR)
+                continue;
+
+            if (written <= 0)
+            {
+                error = written < 0 ? errno : EIO;
+                break;
+            }
+
+            done += written;
+
+            // skip the fully written parts after a short write
+            size_t skip = written;
+            while (count != 0 && skip >= pending->iov_len)
+            {
+                skip -= pending->iov_len;
+                ++pending;
+                --count;
+            }
+            if (count != 0)
+            {
+                pending->iov_base = static_cast<uint8_t*>(pending->iov_base) + skip;
+                pending->iov_len -= skip;
+            }
+        }
+
+        // tell each request how much of its own data got written
+        for (Request& request : batch)
+        {
+            size_t mine = std::min(done, request.data.size());
+            done -= mine;
+
+            if (request.on_write)
+                request.on_write(mine, mine == request.data.size() ? 0 : error);
+        }
+    }
+
+    // one fsync for every sync request in the batch
+    inline void AsyncIO::do_sync(std::deque<Request>& batch)
+    {
+        int error = 0;
+        while (::fsync(batch.front().fd) != 0)
+        {
+            if (errno != EINTR)
+            {
+                error = errno;
+                break;
+            }
+        }
+
+        for (Request& request : batch)
+            if (request.on_sync)
+                request.on_sync(error);
+    }
+
+    /**
+     * @brief Read a range of a file
+     *
+     * @param fd        file descriptor, must stay open until the read is done
+     * @param offset    position in the file
+     * @param len       number of bytes to read, fewer are returned at the end of the file
+     * @param callback  called on the worker thread with the data, or an errno value,
+     *                  must be noexcept
+     */
+    template <typename Callback>
+    inline void AsyncIO::read(int fd, uint64_t offset, size_t len, Callback&& callback)
+    {
+        static_assert(std::is_nothrow_invocable<Callback&, Buffer&&, int>::value,
+                      "AsyncIO callbacks run on a worker thread and must be noexcept");
+
+        Request request{Request::Type::read, fd, offset, len, Buffer(), std::string(),
+                        read_callback(std::forward<Callback>(callback)), nullptr, nullptr};
+        submit(worker_for(fd), std::move(request));
+    }
+
+    //! read a range of a file, errors are thrown from the future as std::system_error
+    inline std::future<Buffer> AsyncIO::read(int fd, uint64_t offset, size_t len)
+    {
+        auto promise = std::make_shared<std::promise<Buffer>>();
+        std::future<Buffer> rval = promise->get_future();
+
+        read(fd, offset, len, [promise](Buffer&& data, int error) noexcept {
+            if (error != 0)
+                detail::fail_promise(*promise, error);
+            else
+                promise->set_value(std::move(data));
+        });
+
+        return rval;
+    }
+
+    //! read a complete file, like file_to_buffer but without blocking the caller
+    template <typename Callback>
+    inline void AsyncIO::read_file(const char* filename, Callback&& callback)
+    {
+        static_assert(std::is_nothrow_invocable<Callback&, Buffer&&, int>::value,
+                      "AsyncIO callbacks run on a worker thread and must be noexcept");
+
+        Request request{Request::Type::read_file, -1, 0, 0, Buffer(), std::string(filename),
+                        read_callback(std::forward<Callback>(callback)), nullptr, nullptr};
+        submit(next_worker++ % workers.size(), std::move(request));
+    }
+
+    inline std::future<Buffer> AsyncIO::read_file(const char* filename)
+    {
+        auto promise = std::make_shared<std::promise<Buffer>>();
+        std::future<Buffer> rval = promise->get_future();
+
+        read_file(filename, [promise](Buffer&& data, int error) noexcept {
+            if (error != 0)
+                detail::fail_promise(*promise, error);
+            else
+                promise->set_value(std::move(data));
+        });
+
+        return rval;
+    }
+
+    /**
+     * @brief Write a buffer to a file
+     *
+     * The buffer is moved into the service and released once written.  Writes that
+     * continue where the previous queued write ends are merged into one system call.
+     *
+     * @param fd        file descriptor, must stay open until the write is done
+     * @param offset    position in the file
+     * @param data      data to write
+     * @param callback  called on the worker thread with the number of bytes written
+     *                  and 0, or an errno value, must be noexcept
+     */
+    template <typename Callback>
+    inline void AsyncIO::write(int fd, uint64_t offset, Buffer&& data, Callback&& callback)
+    {
+        static_assert(std::is_nothrow_invocable<Callback&, size_t, int>::value,
+                      "AsyncIO callbacks run on a worker thread and must be noexcept");
+
+        Request request{Request::Type::write, fd, offset, data.size(), std::move(data), std::string(),
+                        nullptr, write_callback(std::forward<Callback>(callback)), nullptr};
+        submit(worker_for(fd), std::move(request));
+    }
+
+    inline std::future<size_t> AsyncIO::write(int fd, uint64_t offset, Buffer&& data)
+    {
+        auto promise = std::make_shared<std::promise<size_t>>();
+        std::future<size_t> rval = promise->get_future();
+
+        write(fd, offset, std::move(data), [promise](size_t written, int error) noexcept {
+            if (error != 0)
+                detail::fail_promise(*promise, error);
+            else
+                promise->set_value(written);
+        });
+
+        return rval;
+    }
+
+    /**
+     * @brief Flush a file to the disk
+     *
+     * Covers every write to fd submitted before the sync.  Syncs queued up while
+     * an earlier one runs are served by a single fsync.  The callback gets 0 or an
+     * errno value and must be noexcept.
+     */
+    template <typename Callback>
+    inline void AsyncIO::sync(int fd, Callback&& callback)
+    {
+        static_assert(std::is_nothrow_invocable<Callback&, int>::value,
+                      "AsyncIO callbacks run on a worker thread and must be noexcept");
+
+        Request request{Request::Type::sync, fd, 0, 0, Buffer(), std::string(),
+                        nullptr, nullptr, sync_callback(std::forward<Callback>(callback))};
+        submit(worker_for(fd), std::move(request));
+    }
+
+    inline std::future<void> AsyncIO::sync(int fd)
+    {
+        auto promise = std::make_shared<std::promise<void>>();
+        std::future<void> rval = promise->get_future();
+
+        sync(fd, [promise](int error) noexcept {
+            if (error != 0)
+                detail::fail_promise(*promise, error);
+            else
+                promise->set_value();
+        });
+
+        return rval;
+    }
+}
+
+#endif
+/*
+ Copyright (c) 2017 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,31 @@
+#ifndef MUSH_BENCH_BENCH
+#define MUSH_BENCH_BENCH
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+// Results are added here so the compiler cannot drop the work being timed
+static volatile uint64_t sink = 0;
+
+// Best of runs calls of f in milliseconds, the best run is the one least disturbed
+template <typename Function>
+double best_ms(int runs, Function&& f)
+{
+    double best = 1e300;
+
+    for (int i = 0; i < runs; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        if (ms < best)
+            best = ms;
+    }
+
+    return best;
+}
+
+#endif
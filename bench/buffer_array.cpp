@@ -0,0 +1,65 @@
+// write_array and read_array against a write<T> or read<T> call per element
+
+#include <vector>
+
+#include "buffer.hpp"
+
+#include "bench.hpp"
+
+using namespace mush;
+
+constexpr size_t COUNT = 1 << 20;
+constexpr int    RUNS = 7;
+
+static void run(const char* name, bool big_endian_mode, const std::vector<float>& values)
+{
+    double write_each = best_ms(RUNS, [&]
+    {
+        Buffer buffer;
+        for (float v : values)
+            buffer.write(v, big_endian_mode);
+        sink += buffer.size();
+    });
+
+    double write_bulk = best_ms(RUNS, [&]
+    {
+        Buffer buffer;
+        buffer.write_array(values.data(), values.size(), big_endian_mode);
+        sink += buffer.size();
+    });
+
+    Buffer encoded;
+    encoded.write_array(values.data(), values.size(), big_endian_mode);
+    std::vector<float> decoded(values.size());
+
+    double read_each = best_ms(RUNS, [&]
+    {
+        encoded.seek(0);
+        for (float& v : decoded)
+            v = encoded.read<float>(MUSH_DEFAULT_LOC, big_endian_mode);
+        sink += (uint64_t)decoded.back();
+    });
+
+    double read_bulk = best_ms(RUNS, [&]
+    {
+        encoded.seek(0);
+        encoded.read_array(decoded.data(), decoded.size(), big_endian_mode);
+        sink += (uint64_t)decoded.back();
+    });
+
+    std::printf("%-12s write %7.2f ms each %7.2f ms array   read %7.2f ms each %7.2f ms array\n",
+                name, write_each, write_bulk, read_each, read_bulk);
+}
+
+int main()
+{
+    std::vector<float> values(COUNT);
+    for (size_t i = 0; i < COUNT; ++i)
+        values[i] = (float)i * 0.5f;
+
+    std::printf("%zu floats, best of %d runs\n", COUNT, RUNS);
+    run("native", false, values);
+    run("swapped", true, values);
+
+    return 0;
+}
@@ -0,0 +1,87 @@
+// FNV-1a against wyhash on Buffer keys of several lengths, and unordered_map lookups
+// with plain and cached hashes
+
+#include <unordered_map>
+#include <vector>
+
+#include "buffer.hpp"
+
+#include "bench.hpp"
+
+using namespace mush;
+
+constexpr size_t TOTAL_BYTES = 64 << 20;
+constexpr int    RUNS = 7;
+
+template <typename Algorithm>
+static double throughput(const std::vector<Buffer>& keys)
+{
+    hashes::Hash<Buffer, size_t_x64(), Algorithm> hash;
+
+    double ms = best_ms(RUNS, [&]
+    {
+        for (const Buffer& key : keys)
+            sink += hash(key);
+    });
+
+    return (double)keys.size() * keys[0].size() / ms / 1e6;
+}
+
+static Buffer make_key(size_t length, size_t seed)
+{
+    Buffer key;
+    for (size_t i = 0; i < length; ++i)
+        key.write((uint8_t)((seed * 131 + i * 7) >> 3));
+
+    return key;
+}
+
+template <typename Key, typename Hasher>
+static double lookups(const std::vector<Key>& keys)
+{
+    std::unordered_map<Key, size_t, Hasher> map;
+    for (size_t i = 0; i < keys.size(); ++i)
+        map.emplace(keys[i], i);
+
+    return best_ms(RUNS, [&]
+    {
+        for (const Key& key : keys)
+            sink += map.find(key)->second;
+    });
+}
+
+int main()
+{
+    std::printf("hash throughput, GB/s, best of %d runs\n", RUNS);
+    std::printf("%8s %10s %10s\n", "key", "fnv1a", "wyhash");
+
+    for (size_t length : { 8, 16, 32, 64, 256, 1024, 4096 })
+    {
+        std::vector<Buffer> keys;
+        for (size_t i = 0; i < TOTAL_BYTES / length / 16; ++i)
+            keys.push_back(make_key(length, i));
+
+        std::printf("%8zu %10.2f %10.2f\n", length, throughput<hashes::fnv1a>(keys),
+                    throughput<hashes::wyhash>(keys));
+    }
+
+    // long keys looked up repeatedly, where caching the hash pays off
+    std::vector<Buffer> keys;
+    std::vector<hashes::Cached<Buffer>> cached_keys;
+    for (size_t i = 0; i < 20000; ++i)
+    {
+        keys.push_back(make_key(512, i));
+        cached_keys.emplace_back(keys.back());
+        cached_keys.back().hash();
+    }
+
+    using Fnv = hashes::Hash<Buffer, size_t_x64(), hashes::fnv1a>;
+    using Wy = hashes::Hash<Buffer, size_t_x64(), hashes::wyhash>;
+
+    std::printf("\n%zu lookups of 512 byte keys\n", keys.size());
+    std::printf("  fnv1a           %7.2f ms\n", lookups<Buffer, Fnv>(keys));
+    std::printf("  wyhash          %7.2f ms\n", lookups<Buffer, Wy>(keys));
+    std::printf("  cached wyhash   %7.2f ms\n", lookups<hashes::Cached<Buffer>, std::hash<hashes::Cached<Buffer>>>(cached_keys));
+
+    return 0;
+}
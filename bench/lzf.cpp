@@ -0,0 +1,132 @@
+// LZF compression and decompression throughput on text, binary and already compressed
+// data.  Synthetic corpora are used by default, files given as arguments are measured
+// instead.
+
+#define MUSH_IMPLEMENT_COMPRESSION
+#include "compression.hpp"
+
+#include "bench.hpp"
+
+using namespace mush;
+
+constexpr size_t CORPUS_SIZE = 8 << 20;
+constexpr int    RUNS = 7;
+
+static uint64_t next_random(uint64_t& state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+// words picked from a small vocabulary with a skewed distribution, like prose or logs
+static Buffer text_corpus()
+{
+    const char* words[] = { "the", "of", "and", "a", "to", "in", "buffer", "is", "that", "for",
+                            "compression", "it", "with", "as", "was", "on", "data", "header",
+                            "block", "stream", "returns", "value", "error", "size" };
+    constexpr size_t word_count = sizeof(words) / sizeof(words[0]);
+
+    Buffer corpus;
+    uint64_t state = 1;
+    while (corpus.size() < CORPUS_SIZE)
+    {
+        uint64_t r = next_random(state);
+        const char* word = words[(r % word_count) * (r % word_count) / word_count];
+
+        corpus.write_array(word, strlen(word));
+        corpus.write((uint8_t)((r >> 32) % 12 == 0 ? '\n' : ' '));
+    }
+
+    corpus.resize(CORPUS_SIZE);
+    return corpus;
+}
+
+// fixed-size records with counters, small deltas and flags, like a binary log
+static Buffer binary_corpus()
+{
+    Buffer corpus;
+    uint64_t state = 2;
+    uint32_t counter = 0;
+    float position = 0.0f;
+
+    while (corpus.size() < CORPUS_SIZE)
+    {
+        uint64_t r = next_random(state);
+        position += (float)(r % 100) * 0.01f;
+
+        corpus.write(counter++);
+        corpus.write(position);
+        corpus.write((uint16_t)(r >> 40 & 0x3));
+        corpus.write((uint16_t)0);
+        corpus.write((uint32_t)(r >> 20 & 0xff));
+    }
+
+    corpus.resize(CORPUS_SIZE);
+    return corpus;
+}
+
+// random bytes behave like data that has already been compressed
+static Buffer compressed_corpus()
+{
+    Buffer corpus;
+    uint64_t state = 3;
+
+    while (corpus.size() < CORPUS_SIZE)
+        corpus.write(next_random(state));
+
+    corpus.resize(CORPUS_SIZE);
+    return corpus;
+}
+
+static void run(const char* name, const Buffer& corpus)
+{
+    Buffer packed;
+    packed.resize_uninitialized(lzf::compress_bound(corpus.size()));
+
+    Buffer unpacked;
+    unpacked.resize_uninitialized(lzf::decompress_bound(corpus.size()));
+
+    for (lzf::Level level : { lzf::Level::fast, lzf::Level::high })
+    {
+        size_t packed_size = 0;
+        double compress_ms = best_ms(RUNS, [&]
+        {
+            packed_size = lzf::compress_into(corpus.data(), corpus.size(), packed.data(), packed.size(), level);
+        });
+
+        size_t unpacked_size = 0;
+        double decompress_ms = best_ms(RUNS, [&]
+        {
+            unpacked_size = lzf::decompress_into(packed.data(), packed_size, unpacked.data(), unpacked.size());
+        });
+
+        if (unpacked_size != corpus.size() || memcmp(unpacked.data(), corpus.data(), corpus.size()) != 0)
+            std::printf("%s: round trip failed\n", name);
+
+        double mb = corpus.size() / 1e6;
+        std::printf("%-24s %-4s ratio %5.3f  compress %7.1f MB/s  decompress %7.1f MB/s\n",
+                    name, level == lzf::Level::fast ? "fast" : "high", (double)packed_size / corpus.size(),
+                    mb / compress_ms * 1e3, mb / decompress_ms * 1e3);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::printf("best of %d runs\n", RUNS);
+
+    if (argc > 1)
+    {
+        for (int i = 1; i < argc; ++i)
+            run(argv[i], file_to_buffer(argv[i]));
+
+        return 0;
+    }
+
+    run("text", text_corpus());
+    run("binary", binary_corpus());
+    run("already compressed", compressed_corpus());
+
+    return 0;
+}
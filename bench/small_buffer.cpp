@@ -0,0 +1,72 @@
+// Encoding and decoding a short message header with Buffer and with SmallBuffer
+
+#include <cstdlib>
+#include <new>
+
+#include "small_buffer.hpp"
+
+#include "bench.hpp"
+
+using namespace mush;
+
+constexpr size_t COUNT = 2000000;
+constexpr int    RUNS = 7;
+
+// every heap allocation made by the program goes through here
+static size_t allocations = 0;
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+// type, flags, sequence number and payload length, 10 bytes
+template <typename BufferType>
+static void header_round_trip(uint32_t sequence)
+{
+    BufferType header;
+    header.write((uint8_t)3);
+    header.write((uint8_t)0x80);
+    header.write(sequence, true);
+    header.write(sequence * 7, true);
+
+    header.seek(0);
+    uint8_t type = header.template read<uint8_t>();
+    uint8_t flags = header.template read<uint8_t>();
+    uint32_t number = header.template read<uint32_t>(MUSH_DEFAULT_LOC, true);
+    uint32_t length = header.template read<uint32_t>(MUSH_DEFAULT_LOC, true);
+
+    sink += type + flags + number + length;
+}
+
+template <typename BufferType>
+static void run(const char* name)
+{
+    size_t before = allocations;
+    header_round_trip<BufferType>(0);
+    size_t per_header = allocations - before;
+
+    double ms = best_ms(RUNS, []
+    {
+        for (uint32_t i = 0; i < COUNT; ++i)
+            header_round_trip<BufferType>(i);
+    });
+
+    std::printf("%-16s %7.2f ms, %zu allocations per header\n", name, ms, per_header);
+}
+
+int main()
+{
+    std::printf("%zu 10 byte headers encoded and decoded, best of %d runs\n", COUNT, RUNS);
+    run<Buffer>("Buffer");
+    run<SmallBuffer<>>("SmallBuffer<64>");
+
+    return 0;
+}
@@ -20,114 +20,1234 @@
 #include <cstdint>
 #include <cassert>
 #include <memory>
+#include <type_traits>
 
 #include <cstring>
 #include <fstream>
+#include <algorithm>
+#include <limits>
+#include <charconv>
+#include <cstdlib>
+#include <cerrno>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "hash.hpp"
+#include "monadic_error.hpp"
 
 namespace mush
 { 
     constexpr static size_t MUSH_DEFAULT_LOC = ~0;
 
+    class BufferView;
+    class BlockReader;
+
+    namespace detail
+    {
+        // Allocator adaptor that leaves bytes uninitialised when they are constructed
+        // without a value, this is what makes resize_uninitialized possible
+        template <typename Allocator>
+        class uninitialized_allocator : public Allocator
+        {
+            typedef std::allocator_traits<Allocator> traits;
+
+            public:
+                template <typename U>
+                struct rebind
+                {
+                    typedef uninitialized_allocator<typename traits::template rebind_alloc<U>> other;
+                };
+
+                uninitialized_allocator() = default;
+                uninitialized_allocator(const Allocator& alloc) noexcept : Allocator(alloc) {}
+
+                template <typename U>
+                void construct(U* ptr) noexcept(std::is_nothrow_default_constructible<U>::value)
+                {
+                    ::new(static_cast<void*>(ptr)) U;
+                }
+
+                template <typename U, typename... Args>
+                void construct(U* ptr, Args&&... args)
+                {
+                    traits::construct(static_cast<Allocator&>(*this), ptr, std::forward<Args>(args)...);
+                }
+        };
+    }
+
+    /** 
+     * @brief Class for holding raw data
+     *
+     * The storage is allocated through Allocator, see allocator.hpp for arena and pool
+     * allocators suitable for short-lived buffers.  Buffer is the version using the
+     * default allocator.
+     */
+    template <typename Allocator = std::allocator<uint8_t>>
+    class BasicBuffer : public std::vector<uint8_t, detail::uninitialized_allocator<Allocator>>
+    {
+        public:
+            typedef std::vector<uint8_t, detail::uninitialized_allocator<Allocator>> storage_type;
+            typedef Allocator                                                          allocator_type;
+
+            BasicBuffer() = default;
+            explicit BasicBuffer(const Allocator& alloc) noexcept : storage_type(alloc) {}
+
+            allocator_type  get_allocator() const noexcept;
+
+            void            resize(size_t new_size);
+            void            resize(size_t new_size, uint8_t value);
+            void            resize_uninitialized(size_t new_size);
+            uint8_t*        append_uninitialized(size_t bytes);
+
+            bool            can_read(size_t bytes) const noexcept;
+            size_t          pos() const noexcept;
+            const uint8_t*  getptr() const noexcept;
+
+            size_t          hash() const noexcept;
+
+            void            seek(size_t target) const noexcept;
+            void            replace(size_t loc, size_t len, const BasicBuffer& src) noexcept; 
+
+            BasicBuffer     copy_until(const uint8_t delim) const noexcept;
+            BasicBuffer     copy_bytes(size_t len) const;
+
+            BufferView      view() const noexcept;
+
+            template <typename T>
+            void from_stl_type(T&& data);
+
+            template <typename T>
+            T read_strval() const;
+
+            template <typename T>
+            Result<T> read_number() const;
+
+            BlockReader     read_block(size_t bytes) const noexcept;
+
+            template <typename T>
+            T read(size_t where = MUSH_DEFAULT_LOC, bool big_endian_mode = false) const noexcept;
+            
+            template <typename T>
+            T read_le(size_t where = MUSH_DEFAULT_LOC) const noexcept;
+
+            template <typename T>
+            bool read_array(T* dst, size_t count, bool big_endian_mode = false) const noexcept;
+            
+            template <typename T>
+            void write(T&& data, bool big_endian_mode = false) noexcept;
+            
+            template <typename T>
+            void write_le(T&& data) noexcept;
+
+            template <typename T>
+            void write_array(const T* src, size_t count, bool big_endian_mode = false);
+
+            template <typename... T>
+            void write_bytes(T... bytes) noexcept;
+
+            template <typename T>
+            T read_varint() const noexcept;
+
+            template <typename T>
+            bool read_varint(T& value) const noexcept;
+
+            template <typename T>
+            void write_varint(T value);
+
+            template <typename Schema>
+            bool read_record(typename Schema::record_type& record, bool big_endian_mode = false) const noexcept;
+
+            template <typename Schema>
+            void write_record(const typename Schema::record_type& record, bool big_endian_mode = false);
+
+        private:
+            mutable size_t read_ptr = 0;
+    };
+
+    using Buffer = BasicBuffer<>;
+
+    template <typename T> struct is_basic_buffer : std::false_type {};
+    template <typename Allocator> struct is_basic_buffer<BasicBuffer<Allocator>> : std::true_type {};
+
+    // Anything with data() pointing to bytes and size() is written as its contents
+    template <typename T, typename = void> struct is_byte_range : std::false_type {};
+    template <typename T>
+    struct is_byte_range<T, std::void_t<decltype(std::declval<const T&>().size()),
+                                        decltype(std::declval<const T&>().data())>>
+        : std::is_same<std::decay_t<decltype(*std::declval<const T&>().data())>, uint8_t> {};
+
+    /** 
+     * @brief Non-owning read-only view to raw data
+     *
+     * BufferView is a pointer and a length with its own read position.  It provides the
+     * same reading interface as Buffer, but copy_until and copy_bytes return sub-views
+     * instead of allocating new buffers.  Since the read position is a part of the view
+     * rather than the data, any number of views can be used to parse the same buffer
+     * at once, for example from different threads.
+     *
+     * The view does not keep the data alive, the underlying storage must outlive it and
+     * must not be reallocated while the view is in use.
+     */
+    class BufferView
+    {
+        public:
+            BufferView() noexcept = default;
+            BufferView(const uint8_t* data, size_t size) noexcept;
+            template <typename Allocator>
+            BufferView(const BasicBuffer<Allocator>& buffer) noexcept;
+
+            const uint8_t*  data() const noexcept;
+            size_t          size() const noexcept;
+            bool            empty() const noexcept;
+
+            const uint8_t*  begin() const noexcept;
+            const uint8_t*  end() const noexcept;
+
+            uint8_t         operator[](size_t index) const noexcept;
+
+            bool            can_read(size_t bytes) const noexcept;
+            size_t          pos() const noexcept;
+            size_t          remaining() const noexcept;
+            const uint8_t*  getptr() const noexcept;
+
+            void            seek(size_t target) noexcept;
+            void            skip(size_t bytes) noexcept;
+
+            BufferView      subview(size_t offset, size_t len = MUSH_DEFAULT_LOC) const noexcept;
+            BufferView      copy_until(const uint8_t delim) noexcept;
+            BufferView      copy_bytes(size_t len) noexcept;
+
+            Buffer          to_buffer() const;
+
+            template <typename T>
+            T read(size_t where = MUSH_DEFAULT_LOC, bool big_endian_mode = false) noexcept;
+
+            template <typename T>
+            T read_le(size_t where = MUSH_DEFAULT_LOC) noexcept;
+
+            template <typename T>
+            bool read_array(T* dst, size_t count, bool big_endian_mode = false) noexcept;
+
+            template <typename T>
+            T read_varint() noexcept;
+
+            template <typename T>
+            bool read_varint(T& value) noexcept;
+
+            template <typename T>
+            Result<T> read_number();
+
+            BlockReader     read_block(size_t bytes) noexcept;
+
+            template <typename Schema>
+            bool read_record(typename Schema::record_type& record, bool big_endian_mode = false) noexcept;
+
+        private:
+            const uint8_t*  ptr = nullptr;
+            size_t          length = 0;
+            size_t          read_ptr = 0;
+    };
+
+    /** 
+     * @brief Unchecked reader for a block of known size
+     *
+     * Returned by read_block, which checks once that the whole block can be read and
+     * moves the read position of the buffer past it.  Reads from the block are then not
+     * checked at all, apart from assertions in debug builds, so decoding a fixed-layout
+     * block compiles down to plain loads.
+     *
+     *  mush::BlockReader block = buffer.read_block(12);
+     *  if (!block)
+     *      return false;
+     *  uint32_t id = block.read<uint32_t>();
+     *  uint64_t stamp = block.read<uint64_t>();
+     *
+     * Reading past the end of the block is undefined behaviour in release builds.  The
+     * block points into the buffer and must not outlive it.
+     */
+    class BlockReader
+    {
+        public:
+            BlockReader() noexcept = default;
+            BlockReader(const uint8_t* data, size_t size) noexcept : ptr(data), length(size), valid(true) {}
+
+            explicit        operator bool() const noexcept  { return valid; }
+
+            size_t          size() const noexcept           { return length; }
+            size_t          pos() const noexcept            { return offset; }
+            size_t          remaining() const noexcept      { return length - offset; }
+            const uint8_t*  getptr() const noexcept         { return ptr + offset; }
+
+            void            skip(size_t bytes) noexcept;
+
+            template <typename T>
+            T read(bool big_endian_mode = false) noexcept;
+
+            template <typename T>
+            T read_le() noexcept;
+
+            template <typename T>
+            void read_array(T* dst, size_t count, bool big_endian_mode = false) noexcept;
+
+        private:
+            const uint8_t*  ptr = nullptr;
+            size_t          length = 0;
+            size_t          offset = 0;
+            bool            valid = false;
+    };
+
+    /** 
+     * @brief Range of delimiter-separated records in a view
+     *
+     * Iterating gives a BufferView for each record, without the delimiter.  Empty
+     * records between two delimiters are included, but there is no empty record after
+     * a trailing delimiter.  The views point to the original data, nothing is copied.
+     *
+     *  for (mush::BufferView line : mush::records(log, '\n'))
+     *      ...
+     */
+    class RecordRange
+    {
+        public:
+            class iterator
+            {
+                public:
+                    typedef iterator                        self_type;
+                    typedef BufferView                      value_type;
+                    typedef const BufferView&               reference;
+                    typedef const BufferView*               pointer;
+                    typedef std::forward_iterator_tag       iterator_category;
+                    typedef std::ptrdiff_t                  difference_type;
+
+                    iterator() noexcept = default;
+                    iterator(const uint8_t* pos, const uint8_t* end, uint8_t delim) noexcept;
+
+                    self_type& operator++() noexcept;
+                    self_type operator++(int) noexcept { self_type i = *this; ++*this; return i; }
+
+                    reference operator*() const noexcept { return record; }
+                    pointer operator->() const noexcept  { return &record; }
+
+                    bool operator==(const self_type& rhs) const noexcept { return pos == rhs.pos; }
+                    bool operator!=(const self_type& rhs) const noexcept { return pos != rhs.pos; }
+
+                private:
+                    const uint8_t*  pos = nullptr;
+                    const uint8_t*  end = nullptr;
+                    const uint8_t*  next = nullptr;
+                    BufferView      record;
+                    uint8_t         delim = 0;
+            };
+
+            RecordRange(BufferView data, uint8_t delim) noexcept : data(data), delim(delim) {}
+
+            iterator begin() const noexcept;
+            iterator end() const noexcept;
+
+        private:
+            BufferView  data;
+            uint8_t     delim;
+    };
+
+    inline RecordRange records(BufferView data, uint8_t delim = '\n') noexcept;
+
+    inline Buffer file_to_buffer(const char* filename);
+
+    //! maximum encoded size of a 64-bit varint
+    constexpr static size_t MAX_VARINT_SIZE = 10;
+
+    template <typename T>
+    constexpr size_t varint_size(T value) noexcept;
+
+    constexpr uint64_t zigzag_encode(int64_t value) noexcept;
+    constexpr int64_t zigzag_decode(uint64_t value) noexcept;
+
+    // IMPLEMENTATIONS
+
+    namespace detail
+    {
+        inline uint16_t bswap(uint16_t v) noexcept
+        {
+            #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_bswap16(v);
+            #else
+            return (v >> 8) | (v << 8);
+            #endif
+        }
+
+        inline uint32_t bswap(uint32_t v) noexcept
+        {
+            #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_bswap32(v);
+            #else
+            return ((v >> 24) & 0xff) | ((v >> 8) & 0xff00) | ((v << 8) & 0xff0000) | (v << 24);
+            #endif
+        }
+
+        inline uint64_t bswap(uint64_t v) noexcept
+        {
+            #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_bswap64(v);
+            #else
+            return ((uint64_t)bswap((uint32_t)v) << 32) | bswap((uint32_t)(v >> 32));
+            #endif
+        }
+
+        template <size_t Size> struct swap_word { };
+        template <> struct swap_word<2> { typedef uint16_t type; };
+        template <> struct swap_word<4> { typedef uint32_t type; };
+        template <> struct swap_word<8> { typedef uint64_t type; };
+    }
+
+    // We want to be able to swap endianness
+    template <typename T>
+    std::decay_t<T> endian_swap(T&& value) noexcept
+    {
+        using value_type = std::decay_t<T>;
+
+        value_type rval = std::forward<T>(value);
+
+        if constexpr (sizeof(value_type) == 2 || sizeof(value_type) == 4 || sizeof(value_type) == 8)
+        {
+            // goes through memcpy so floats and enums get swapped as well
+            typename detail::swap_word<sizeof(value_type)>::type word;
+            memcpy(&word, &rval, sizeof(word));
+            word = detail::bswap(word);
+            memcpy(&rval, &word, sizeof(word));
+        }
+        else if constexpr (sizeof(value_type) > 1)
+        {
+            uint8_t bytes[sizeof(value_type)];
+            memcpy(bytes, &rval, sizeof(value_type));
+
+            for (size_t i = 0; i < sizeof(value_type) / 2; ++i)
+                std::swap(bytes[i], bytes[sizeof(value_type)-1-i]);
+
+            memcpy(&rval, bytes, sizeof(value_type));
+        }
+
+        return rval;
+    }
+
+    //! Checks if the system is big-endian
+    /*!
+        Performs fast check if the system is big-endian
+    */
+    inline constexpr bool big_endian() noexcept
+    {
+        uint16_t t = 0xbe1e;
+        if ((uint8_t) *(&t) == 0x1e)
+            return false;
+
+        return true;
+    }
+
+    //! map signed values to unsigned so that small magnitudes stay small, 0, -1, 1, -2 -> 0, 1, 2, 3
+    constexpr uint64_t zigzag_encode(int64_t value) noexcept
+    {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    constexpr int64_t zigzag_decode(uint64_t value) noexcept
+    {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+
+    /** 
+     * @brief Number of bytes write_varint uses for a value
+     *
+     * Signed values are counted zigzag-encoded, the same way write_varint stores them.
+     * Useful for reserving exactly the right amount of space before writing.
+     */
+    template <typename T>
+    constexpr size_t varint_size(T value) noexcept
+    {
+        static_assert(std::is_integral<T>::value, "varint_size requires integral type");
+
+        uint64_t v = std::is_signed<T>::value ? zigzag_encode(static_cast<int64_t>(value))
+                                              : static_cast<uint64_t>(value);
+        #if defined(__GNUC__) || defined(__clang__)
+        // 7 bits per byte, computed from the index of the highest set bit
+        return ((63 - __builtin_clzll(v | 1)) * 9 + 73) / 64;
+        #else
+        size_t rval = 1;
+        while (v >= 0x80)
+        {
+            v >>= 7;
+            ++rval;
+        }
+        return rval;
+        #endif
+    }
+
+    namespace detail
+    {
+        // Reads a value from possibly unaligned memory, swapping the bytes if needed
+        template <typename T>
+        inline T load(const uint8_t* src, bool big_endian_mode) noexcept
+        {
+            T rval;
+            memcpy(&rval, src, sizeof(T));
+
+            if constexpr (std::is_pod<T>::value)
+                if ((big_endian() && !big_endian_mode) || (!big_endian() && big_endian_mode))
+                    rval = endian_swap(rval);
+
+            return rval;
+        }
+
+        // Writes a value to possibly unaligned memory, swapping the bytes if needed
+        template <typename T>
+        inline void store(uint8_t* dst, T value, bool big_endian_mode) noexcept
+        {
+            if constexpr (std::is_pod<T>::value)
+                if ((big_endian() && !big_endian_mode) || (!big_endian() && big_endian_mode))
+                    value = endian_swap(value);
+
+            memcpy(dst, &value, sizeof(T));
+        }
+
+        // Copies count elements of size Size, reversing the byte order of each
+        template <size_t Size>
+        inline void swap_copy(uint8_t* dst, const uint8_t* src, size_t count) noexcept
+        {
+            const uint8_t* src_end = src + count * Size;
+
+            #if defined(__SSSE3__)
+            if constexpr (Size == 2 || Size == 4 || Size == 8)
+            {
+                const __m128i mask = Size == 2 ? _mm_setr_epi8(1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14)
+                                   : Size == 4 ? _mm_setr_epi8(3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12)
+                                   :             _mm_setr_epi8(7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8);
+
+                for (; src_end - src >= 16; src += 16, dst += 16)
+                {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_shuffle_epi8(v, mask));
+                }
+            }
+            #endif
+
+            if constexpr (Size == 2 || Size == 4 || Size == 8)
+            {
+                typename swap_word<Size>::type word;
+                for (; src < src_end; src += Size, dst += Size)
+                {
+                    memcpy(&word, src, Size);
+                    word = bswap(word);
+                    memcpy(dst, &word, Size);
+                }
+            }
+            else
+            {
+                for (; src < src_end; src += Size, dst += Size)
+                    for (size_t b = 0; b < Size; ++b)
+                        dst[b] = src[Size - 1 - b];
+            }
+        }
+
+        // Copies an array of values, swapping the bytes of each element if needed
+        template <typename T>
+        inline void copy_array(uint8_t* dst, const uint8_t* src, size_t count, bool big_endian_mode) noexcept
+        {
+            if constexpr (std::is_arithmetic<T>::value && sizeof(T) > 1)
+            {
+                if ((big_endian() && !big_endian_mode) || (!big_endian() && big_endian_mode))
+                {
+                    swap_copy<sizeof(T)>(dst, src, count);
+                    return;
+                }
+            }
+
+            memcpy(dst, src, count * sizeof(T));
+        }
+
+        // Writes value as unsigned LEB128, dst must have room for varint_size(value) bytes
+        inline size_t encode_varint(uint8_t* dst, uint64_t value) noexcept
+        {
+            uint8_t* start = dst;
+            while (value >= 0x80)
+            {
+                *dst++ = static_cast<uint8_t>(value) | 0x80;
+                value >>= 7;
+            }
+            *dst++ = static_cast<uint8_t>(value);
+
+            return dst - start;
+        }
+
+        // Reads unsigned LEB128 from at most avail bytes, returns the number of bytes
+        // used or 0 if the data is truncated or does not fit in 64 bits
+        inline size_t decode_varint(const uint8_t* src, size_t avail, uint64_t& value) noexcept
+        {
+            #if defined(__GNUC__) || defined(__clang__)
+            if (avail >= 8)
+            {
+                // Find the terminating byte of the first eight with one load, then
+                // pack the 7-bit groups together without looping over the bytes.
+                uint64_t word = load<uint64_t>(src, false);
+                uint64_t stop = ~word & 0x8080808080808080ull;
+
+                if (stop != 0)
+                {
+                    size_t bits = __builtin_ctzll(stop);
+                    uint64_t x = word & (stop ^ (stop - 1)) & 0x7f7f7f7f7f7f7f7full;
+
+                    x = (x & 0x007f007f007f007full) | ((x & 0x7f007f007f007f00ull) >> 1);
+                    x = (x & 0x00003fff00003fffull) | ((x & 0x3fff00003fff0000ull) >> 2);
+                    x = (x & 0x000000000fffffffull) | ((x & 0x0fffffff00000000ull) >> 4);
+
+                    value = x;
+                    return bits / 8 + 1;
+                }
+            }
+            #endif
+
+            uint64_t rval = 0;
+            for (size_t i = 0; i < avail && i < MAX_VARINT_SIZE; ++i)
+            {
+                uint8_t byte = src[i];
+
+                // the tenth byte may only hold the 64th bit
+                if (i == MAX_VARINT_SIZE - 1 && byte > 1)
+                    return 0;
+
+                rval |= static_cast<uint64_t>(byte & 0x7f) << (7 * i);
+
+                if ((byte & 0x80) == 0)
+                {
+                    value = rval;
+                    return i + 1;
+                }
+            }
+
+            return 0;
+        }
+
+        // Converts a decoded varint to T, undoing zigzag for signed types, false if
+        // the value does not fit
+        template <typename T>
+        inline bool from_varint(uint64_t raw, T& value) noexcept
+        {
+            static_assert(std::is_integral<T>::value, "varint requires integral type");
+
+            if constexpr (std::is_signed<T>::value)
+            {
+                int64_t v = zigzag_decode(raw);
+                if (v < static_cast<int64_t>(std::numeric_limits<T>::min())
+                 || v > static_cast<int64_t>(std::numeric_limits<T>::max()))
+                    return false;
+                value = static_cast<T>(v);
+            } else {
+                if (raw > static_cast<uint64_t>(std::numeric_limits<T>::max()))
+                    return false;
+                value = static_cast<T>(raw);
+            }
+
+            return true;
+        }
+
+        template <typename T>
+        inline uint64_t to_varint(T value) noexcept
+        {
+            static_assert(std::is_integral<T>::value, "varint requires integral type");
+
+            if constexpr (std::is_signed<T>::value)
+                return zigzag_encode(static_cast<int64_t>(value));
+            else
+                return static_cast<uint64_t>(value);
+        }
+    }
+
+    namespace detail
+    {
+        // Returns pointer past the first delim in [src, src + len), or src + len if
+        // there is none.  memchr is vectorised by the C library, SSE2/AVX2 on x86.
+        inline const uint8_t* find_byte(const uint8_t* src, size_t len, uint8_t delim) noexcept
+        {
+            const void* found = memchr(src, delim, len);
+            return found ? static_cast<const uint8_t*>(found) + 1 : src + len;
+        }
+    }
+
+    namespace detail
+    {
+        // Parses a number from text, returns pointer past it, nullptr if there is no
+        // number and begin if the number does not fit in T
+        template <typename T>
+        inline const uint8_t* parse_number(const uint8_t* begin, const uint8_t* end, T& value) noexcept
+        {
+            static_assert(std::is_arithmetic<T>::value && !std::is_same<T, bool>::value,
+                          "read_number requires arithmetic type");
+
+            const char* first = reinterpret_cast<const char*>(begin);
+            const char* last = reinterpret_cast<const char*>(end);
+
+            #if !defined(__cpp_lib_to_chars)
+            if constexpr (std::is_floating_point<T>::value)
+            {
+                // no floating point from_chars, strtod needs a terminated copy
+                char text[64];
+                size_t len = std::min<size_t>(last - first, sizeof(text) - 1);
+                memcpy(text, first, len);
+                text[len] = 0;
+
+                if (len == 0 || text[0] == ' ' || text[0] == '+' || (text[0] >= '\t' && text[0] <= '\r'))
+                    return nullptr;
+
+                char* parsed;
+                errno = 0;
+                long double v = strtold(text, &parsed);
+
+                if (parsed == text)
+                    return nullptr;
+
+                if (errno == ERANGE || v > std::numeric_limits<T>::max() || v < std::numeric_limits<T>::lowest())
+                    return begin;
+
+                value = static_cast<T>(v);
+                return begin + (parsed - text);
+            }
+            else
+            #endif
+            {
+                std::from_chars_result r = std::from_chars(first, last, value);
+
+                if (r.ec == std::errc::invalid_argument)
+                    return nullptr;
+
+                if (r.ec == std::errc::result_out_of_range)
+                    return begin;
+
+                return reinterpret_cast<const uint8_t*>(r.ptr);
+            }
+        }
+    }
+
+    // Buffer class implementations
+
+    //! get data pointer for the buffer
+    template <typename Allocator>
+    inline const uint8_t* BasicBuffer<Allocator>::getptr() const noexcept { return &this->at(0); }
+
+    //! return the position of read_ptr
+    template <typename Allocator>
+    inline size_t BasicBuffer<Allocator>::pos() const noexcept
+    {
+        return read_ptr;
+    }
+
+    //! move the read_ptr
+    template <typename Allocator>
+    inline void BasicBuffer<Allocator>::seek(size_t target) const noexcept
+    {
+        if (target < this->size()) read_ptr = target;
+    }
+
+    /** 
+     * @brief Read data until a byte is met
+     * 
+     * @param delim byte ending the search
+     * 
+     * @return A new buffer holding all the values up to and including the delim byte.
+     */
+    template <typename Allocator>
+    inline BasicBuffer<Allocator> BasicBuffer<Allocator>::copy_until(const uint8_t delim) const noexcept
+    {
+        BasicBuffer rval(this->get_allocator());
+        if (read_ptr >= this->size())
+            return rval;
+
+        const uint8_t* start = this->data() + read_ptr;
+        const uint8_t* end = detail::find_byte(start, this->size() - read_ptr, delim);
+
+        rval.insert(rval.end(), start, end);
+        read_ptr += end - start;
+
+        return rval;
+    };
+    
+    /** 
+     * @brief Read data from a buffer into a new buffer
+     * 
+     * @param len Number of bytes to be read
+     * 
+     * @return A new buffer containing len bytes of data.
+     */
+    template <typename Allocator>
+    inline BasicBuffer<Allocator> BasicBuffer<Allocator>::copy_bytes(size_t len) const
+    {
+        BasicBuffer rval(this->get_allocator());
+        if (this->size() - read_ptr < len)
+            return rval;
+
+        rval.insert(rval.end(), this->data() + read_ptr, this->data() + read_ptr + len);
+        read_ptr += len;
+
+        return rval;
+    }
+
+    /** 
+     * @brief Convert from stl type to a buffer
+     *
+     * Takes a stl type and replaces contents of the buffer with the
+     * contents of the type.  Mostly useful for std::string
+     * 
+     * @param s  input.
+     *
+     */
+    template <typename Allocator>
+    template <typename T>
+    inline void BasicBuffer<Allocator>::from_stl_type(T&& s)
+    {
+        this->clear();
+        std::copy(s.begin(), s.end(), back_inserter(*this));
+    }
+
+    /** 
+     * @brief Checks if there are still enough data remaining that can be read
+     * 
+     * @param bytes  How many bytes need still to be read
+     * 
+     * @return true if size of the buffer is large enough for s bytes of data to be read, otherwise false
+     */
+    template <typename Allocator>
+    inline bool BasicBuffer<Allocator>::can_read(size_t bytes) const noexcept
+    {
+        if (this->size() < pos() + bytes)
+            return false;
+
+        return true;
+    };
+
+    /** 
+     * @brief Read a string that represents a number
+     * 
+     * @return Number of requested type represented by the text data read, or 0 if
+     *         there is no valid number at the read position, see read_number
+     *
+     */
+    template <typename Allocator>
+    template <typename T>
+    inline T BasicBuffer<Allocator>::read_strval() const
+    {
+        return read_number<T>().value_or(T());
+    }
+
+    /** 
+     * @brief Parse a number written as text
+     *
+     * Accepts what std::from_chars accepts: decimal integers with an optional minus
+     * sign for signed types, and decimal or scientific notation for floating point
+     * types.  Leading whitespace or plus signs are not skipped.  Nothing is allocated.
+     * 
+     * @return The number, with read_ptr moved past its last character, or an error if
+     *         there is no number at read_ptr or it does not fit in T, in which case
+     *         read_ptr is not moved.
+     */
+    template <typename Allocator>
+    template <typename T>
+    inline Result<T> BasicBuffer<Allocator>::read_number() const
+    {
+        if (read_ptr >= this->size())
+            return Error("end of buffer");
+
+        T value;
+        const uint8_t* start = this->data() + read_ptr;
+        const uint8_t* end = detail::parse_number(start, this->data() + this->size(), value);
+
+        if (end == nullptr)
+            return Error("not a number");
+
+        if (end == start)
+            return Error("out of range");
+
+        read_ptr += end - start;
+        return value;
+    }
+
+    /** 
+     * @brief Take a block of data for unchecked reading
+     * 
+     * @param bytes size of the block
+     * 
+     * @return A reader for the next bytes bytes, with read_ptr moved past them, or an
+     *         empty reader that converts to false if there is not enough data, in which
+     *         case read_ptr is not moved.
+     */
+    template <typename Allocator>
+    inline BlockReader BasicBuffer<Allocator>::read_block(size_t bytes) const noexcept
+    {
+        if (read_ptr > this->size() || this->size() - read_ptr < bytes)
+            return BlockReader();
+
+        BlockReader rval(this->data() + read_ptr, bytes);
+        read_ptr += bytes;
+
+        return rval;
+    }
+            
+    //! resize the buffer, new bytes are zeroed
+    template <typename Allocator>
+    inline void BasicBuffer<Allocator>::resize(size_t new_size)
+    {
+        storage_type::resize(new_size, 0);
+    }
+
+    //! resize the buffer, new bytes are set to value
+    template <typename Allocator>
+    inline void BasicBuffer<Allocator>::resize(size_t new_size, uint8_t value)
+    {
+        storage_type::resize(new_size, value);
+    }
+
+    /** 
+     * @brief Get the allocator the buffer was made with
+     *
+     * The storage wraps it to allow resize_uninitialized, this returns the allocator
+     * itself, not the wrapper.
+     */
+    template <typename Allocator>
+    inline Allocator BasicBuffer<Allocator>::get_allocator() const noexcept
+    {
+        return storage_type::get_allocator();
+    }
+
+    /** 
+     * @brief Resize the buffer without initialising new bytes
+     *
+     * Use when the new bytes are going to be overwritten anyway, this avoids writing
+     * them twice.  Contents of the new bytes are unspecified.
+     * 
+     * @param new_size  new size of the buffer
+     */
+    template <typename Allocator>
+    inline void BasicBuffer<Allocator>::resize_uninitialized(size_t new_size)
+    {
+        storage_type::resize(new_size);
+    }
+
+    /** 
+     * @brief Grow the buffer by uninitialised bytes
+     * 
+     * @param bytes     number of bytes to add to the end of the buffer
+     * 
+     * @return pointer to the first added byte, there is room to write bytes bytes.
+     *         Valid until the buffer is reallocated.
+     */
+    template <typename Allocator>
+    inline uint8_t* BasicBuffer<Allocator>::append_uninitialized(size_t bytes)
+    {
+        size_t start = this->size();
+        storage_type::resize(start + bytes);
+        return this->data() + start;
+    }
+
+    /** 
+     * @brief Replace data in a buffer
+     * 
+     * @param loc   where in buffer the replaced data starts
+     * @param len   how many bytes of the data will be replaced
+     * @param src   source data buffer
+     */
+    template <typename Allocator>
+    inline void BasicBuffer<Allocator>::replace(size_t loc, size_t len, const BasicBuffer& src) noexcept
+    {
+        // make sure the buffer is large enough
+        if (this->size() - loc < len)
+            this->resize(loc + len);
+
+        // do not read more than we can
+        if (src.size() > len)
+            len = src.size();
+
+        memcpy(this->data() + loc, src.data(), len);
+    }
+
+    /** 
+     * @brief Read data of type T from the buffer
+     * 
+     * @param where the position where to read, if omitted, read_ptr is used as the position
+     * 
+     * @return Data read as type T.
+     */
+    template <typename Allocator>
+    template <typename T>
+    inline T BasicBuffer<Allocator>::read(size_t where, bool big_endian_mode) const noexcept
+    {
+        if (where == MUSH_DEFAULT_LOC)
+            where = read_ptr;
+
+        T rval = detail::load<T>(&this->at(where), big_endian_mode);
+
+        read_ptr += sizeof(T);
+
+        return rval;
+    }
+
+    template <typename Allocator>
+    template <typename T>
+    inline T BasicBuffer<Allocator>::read_le(size_t where) const noexcept
+    {
+        return read<T>(where, true);
+    }
+
+    /** 
+     * @brief Read an array of values of type T from the buffer
+     *
+     * Reads all the values with a single copy, swapping the byte order of arithmetic
+     * types if needed.
+     * 
+     * @param dst               where to write the values
+     * @param count             number of values to read
+     * @param big_endian_mode   byte order of the data, as with read
+     * 
+     * @return true if the values were read, false if there is not enough data, in
+     *         which case nothing is read.
+     */
+    template <typename Allocator>
+    template <typename T>
+    inline bool BasicBuffer<Allocator>::read_array(T* dst, size_t count, bool big_endian_mode) const noexcept
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "read_array requires trivially copyable type");
+
+        if (count > (this->size() - std::min(read_ptr, this->size())) / sizeof(T))
+            return false;
+
+        detail::copy_array<T>(reinterpret_cast<uint8_t*>(dst), this->data() + read_ptr, count, big_endian_mode);
+        read_ptr += count * sizeof(T);
+
+        return true;
+    }
+            
+    /** 
+     * @brief Write data of type T to the end of the buffer
+     * 
+     * @param data  data to be written into the buffer
+     */
+    template <typename Allocator>
+    template <typename T>
+    inline void BasicBuffer<Allocator>::write(T&& data, bool big_endian_mode) noexcept
+    {
+        using value_type = std::decay_t<T>;
+
+        if constexpr(is_byte_range<value_type>::value)
+        {
+            this->insert(std::end(*this), data.data(), data.data() + data.size());
+        }
+        else if constexpr(std::is_pod<value_type>::value)
+        {
+            detail::store<value_type>(append_uninitialized(sizeof(value_type)), data, big_endian_mode);
+        } else {
+            memcpy(append_uninitialized(sizeof(value_type)), &data, sizeof(value_type)); 
+        }
+    }
+
+    template <typename Allocator>
+    template <typename T>
+    inline void BasicBuffer<Allocator>::write_le(T&& data) noexcept
+    {
+        write(std::forward<T>(data), true);
+    }
+
+    /** 
+     * @brief Write an array of values of type T to the end of the buffer
+     *
+     * Grows the buffer once and copies all the values in one go, swapping the byte
+     * order of arithmetic types if needed.
+     * 
+     * @param src               values to be written
+     * @param count             number of values
+     * @param big_endian_mode   byte order of the data, as with write
+     */
+    template <typename Allocator>
+    template <typename T>
+    inline void BasicBuffer<Allocator>::write_array(const T* src, size_t count, bool big_endian_mode)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "write_array requires trivially copyable type");
+
+        uint8_t* dst = append_uninitialized(count * sizeof(T));
+        detail::copy_array<T>(dst, reinterpret_cast<const uint8_t*>(src), count, big_endian_mode);
+    }
+
+    /** 
+     * @brief Write series of bytes into the buffer
+     * 
+     * @param bytes  bytes to be written
+     */
+    template <typename Allocator>
+    template <typename... Ts>
+    inline void BasicBuffer<Allocator>::write_bytes(Ts... bytes) noexcept
+    {
+        const uint8_t values[] = { static_cast<uint8_t>(bytes)... };
+        this->insert(std::end(*this), std::begin(values), std::end(values));
+    }
+
     /** 
-     * @brief Class for holding raw data
+     * @brief Read a variable-length integer
+     *
+     * Unsigned types are read as LEB128, signed types as zigzag-encoded LEB128, as
+     * written by write_varint.
+     * 
+     * @param value where to store the value
+     * 
+     * @return true if a value was read, false if the data is truncated, malformed or
+     *         the value does not fit in T, in which case read_ptr is not moved.
      */
-    class Buffer : public std::vector<uint8_t>
+    template <typename Allocator>
+    template <typename T>
+    inline bool BasicBuffer<Allocator>::read_varint(T& value) const noexcept
     {
-        public:
-            bool            can_read(size_t bytes) const noexcept;
-            size_t          pos() const noexcept;
-            const uint8_t*  getptr() const noexcept;
+        if (read_ptr >= this->size())
+            return false;
 
-            size_t          hash() const noexcept;
+        uint64_t raw;
+        size_t used = detail::decode_varint(this->data() + read_ptr, this->size() - read_ptr, raw);
 
-            void            seek(size_t target) const noexcept;
-            void            replace(size_t loc, size_t len, const Buffer& src) noexcept; 
+        if (used == 0 || !detail::from_varint(raw, value))
+            return false;
 
-            Buffer          copy_until(const uint8_t delim) const noexcept;
-            Buffer          copy_bytes(size_t len) const;
+        read_ptr += used;
+        return true;
+    }
 
-            template <typename T>
-            void from_stl_type(T&& data);
+    //! read a variable-length integer, value-initialised T if it cannot be read
+    template <typename Allocator>
+    template <typename T>
+    inline T BasicBuffer<Allocator>::read_varint() const noexcept
+    {
+        T rval = T();
+        if (!read_varint(rval))
+            assert(0 && "invalid varint in a buffer");
 
-            template <typename T>
-            T read_strval() const;
+        return rval;
+    }
 
-            template <typename T>
-            T read(size_t where = MUSH_DEFAULT_LOC, bool big_endian_mode = false) const noexcept;
-            
-            template <typename T>
-            T read_le(size_t where = MUSH_DEFAULT_LOC) const noexcept;
-            
-            template <typename T>
-            void write(T&& data, bool big_endian_mode = false) noexcept;
-            
-            template <typename T>
-            void write_le(T&& data) noexcept;
+    /** 
+     * @brief Write a variable-length integer to the end of the buffer
+     *
+     * Uses 7 bits per byte, so values below 128 take a single byte.  Signed values
+     * are zigzag-encoded first to keep small negative numbers short as well.
+     * 
+     * @param value integer to be written
+     */
+    template <typename Allocator>
+    template <typename T>
+    inline void BasicBuffer<Allocator>::write_varint(T value)
+    {
+        uint64_t raw = detail::to_varint(value);
+        detail::encode_varint(append_uninitialized(varint_size(raw)), raw);
+    }
 
-            template <typename... T>
-            void write_bytes(T... bytes) noexcept;
+    /** 
+     * @brief Read a fixed-layout record described by a Schema, see schema.hpp
+     *
+     * The size of the whole record is checked once, after which all the fields are
+     * loaded without further checks.
+     * 
+     * @param record            where to store the fields
+     * @param big_endian_mode   byte order of the data, as with read
+     * 
+     * @return true if the record was read, false if there is not enough data, in
+     *         which case nothing is read.
+     */
+    template <typename Allocator>
+    template <typename Schema>
+    inline bool BasicBuffer<Allocator>::read_record(typename Schema::record_type& record, bool big_endian_mode) const noexcept
+    {
+        if (read_ptr > this->size() || this->size() - read_ptr < Schema::size)
+            return false;
 
-        private:
-            mutable size_t read_ptr = 0;
-            
-            template <typename... T>
-            void write_bytes_impl(uint8_t b, T... bytes) noexcept;
-    };
+        Schema::load(this->data() + read_ptr, record, big_endian_mode);
+        read_ptr += Schema::size;
 
-    inline Buffer file_to_buffer(const char* filename);
+        return true;
+    }
 
-    // IMPLEMENTATIONS
+    //! write a fixed-layout record described by a Schema to the end of the buffer
+    template <typename Allocator>
+    template <typename Schema>
+    inline void BasicBuffer<Allocator>::write_record(const typename Schema::record_type& record, bool big_endian_mode)
+    {
+        Schema::store(append_uninitialized(Schema::size), record, big_endian_mode);
+    }
 
-    // We want to be able to swap endianness
-    template <typename T>
-    T endian_swap(T&& value) noexcept
+    //! get a view to the whole buffer, the view has its own read position
+    template <typename Allocator>
+    inline BufferView BasicBuffer<Allocator>::view() const noexcept
     {
-        union
-        {
-            T value;
-            uint8_t value_u8[sizeof(T)];
-        } src, dst;
+        return BufferView(*this);
+    }
 
-        src.value = std::forward<T>(value);
+    // BufferView class implementations
 
-        for (size_t i = 0; i < sizeof(T); ++i)
-            dst.value_u8[i] = src.value_u8[sizeof(T)-1-i];
+    inline BufferView::BufferView(const uint8_t* data, size_t size) noexcept
+        : ptr(data), length(size) {}
 
-        return dst.value;
-    }
+    template <typename Allocator>
+    inline BufferView::BufferView(const BasicBuffer<Allocator>& buffer) noexcept
+        : ptr(buffer.data()), length(buffer.size()) {}
 
-    // Required for hash functions
-    constexpr bool size_t_x64() noexcept
-    { return sizeof(size_t) == 8 ? true : false; }
+    inline const uint8_t* BufferView::data() const noexcept { return ptr; }
+    inline size_t BufferView::size() const noexcept { return length; }
+    inline bool BufferView::empty() const noexcept { return length == 0; }
 
-    //! Checks if the system is big-endian
-    /*!
-        Performs fast check if the system is big-endian
-    */
-    inline constexpr bool big_endian() noexcept
-    {
-        uint16_t t = 0xbe1e;
-        if ((uint8_t) *(&t) == 0x1e)
-            return false;
+    inline const uint8_t* BufferView::begin() const noexcept { return ptr; }
+    inline const uint8_t* BufferView::end() const noexcept { return ptr + length; }
 
-        return true;
+    inline uint8_t BufferView::operator[](size_t index) const noexcept
+    {
+        assert(index < length);
+        return ptr[index];
     }
 
-    // Buffer class implementations
-
-    //! get data pointer for the buffer
-    inline const uint8_t* Buffer::getptr() const noexcept { return &this->at(0); }
+    //! get pointer to the data at the current read position
+    inline const uint8_t* BufferView::getptr() const noexcept { return ptr + read_ptr; }
 
     //! return the position of read_ptr
-    inline size_t Buffer::pos() const noexcept
+    inline size_t BufferView::pos() const noexcept { return read_ptr; }
+
+    //! return how many bytes are left to be read
+    inline size_t BufferView::remaining() const noexcept { return length - read_ptr; }
+
+    //! checks if there are still enough data remaining that can be read
+    inline bool BufferView::can_read(size_t bytes) const noexcept
     {
-        return read_ptr;
+        return bytes <= length - read_ptr;
     }
 
     //! move the read_ptr
-    inline void Buffer::seek(size_t target) const noexcept
+    inline void BufferView::seek(size_t target) noexcept
+    {
+        if (target < length) read_ptr = target;
+    }
+
+    //! move the read_ptr forward, stopping at the end of the view
+    inline void BufferView::skip(size_t bytes) noexcept
     {
-        if (target < size()) read_ptr = target;
+        read_ptr = can_read(bytes) ? read_ptr + bytes : length;
+    }
+
+    /** 
+     * @brief Create a view to a part of this view
+     * 
+     * @param offset    start of the sub-view
+     * @param len       length of the sub-view, if omitted or too long, the sub-view
+     *                  extends to the end of this view
+     * 
+     * @return A new view with its read position at the start
+     */
+    inline BufferView BufferView::subview(size_t offset, size_t len) const noexcept
+    {
+        if (offset > length)
+            offset = length;
+
+        if (len > length - offset)
+            len = length - offset;
+
+        return BufferView(ptr + offset, len);
     }
 
     /** 
@@ -135,225 +1255,240 @@ namespace mush
      * 
      * @param delim byte ending the search
      * 
-     * @return A new buffer holding all the values up to and including the delim byte.
+     * @return A view to all the values up to and including the delim byte.
      */
-    inline Buffer Buffer::copy_until(const uint8_t delim) const noexcept
+    inline BufferView BufferView::copy_until(const uint8_t delim) noexcept
     {
-        Buffer rval;
-        uint8_t v;
-        while(read_ptr < size())
-        {
-            v = this->at(read_ptr);
-            rval.emplace_back(v);
-            read_ptr++;
-            if (delim == v)
-                break;
-        }
-        return rval;
-    };
-    
+        size_t start = read_ptr;
+        if (start >= length)
+            return BufferView();
+
+        const uint8_t* end = detail::find_byte(ptr + start, length - start, delim);
+        read_ptr = end - ptr;
+
+        return BufferView(ptr + start, read_ptr - start);
+    }
+
     /** 
-     * @brief Read data from a buffer into a new buffer
+     * @brief Read data from the view into a sub-view
      * 
      * @param len Number of bytes to be read
      * 
-     * @return A new buffer containing len bytes of data.
+     * @return A view to len bytes of data, or an empty view if there is not enough data
      */
-    inline Buffer Buffer::copy_bytes(size_t len) const
+    inline BufferView BufferView::copy_bytes(size_t len) noexcept
     {
-        Buffer rval;
-        if (size() - read_ptr < len)
-            return rval;
+        if (!can_read(len))
+            return BufferView();
 
-        std::copy(data(), data() + len, back_inserter(rval));
+        BufferView rval(ptr + read_ptr, len);
         read_ptr += len;
 
         return rval;
     }
 
+    //! copy the viewed data into a new buffer
+    inline Buffer BufferView::to_buffer() const
+    {
+        Buffer rval;
+        rval.insert(rval.end(), begin(), end());
+        return rval;
+    }
+
     /** 
-     * @brief Convert from stl type to a buffer
-     *
-     * Takes a stl type and replaces contents of the buffer with the
-     * contents of the type.  Mostly useful for std::string
+     * @brief Read data of type T from the view
      * 
-     * @param s  input.
-     *
+     * @param where the position where to read, if omitted, read_ptr is used as the position
+     * 
+     * @return Data read as type T, or value-initialised T if there is not enough data
      */
     template <typename T>
-    inline void Buffer::from_stl_type(T&& s)
+    inline T BufferView::read(size_t where, bool big_endian_mode) noexcept
     {
-        this->clear();
-        std::copy(s.begin(), s.end(), back_inserter(*this));
+        if (where == MUSH_DEFAULT_LOC)
+            where = read_ptr;
+
+        if (where > length || length - where < sizeof(T))
+        {
+            assert(0 && "read past the end of a buffer view");
+            return T();
+        }
+
+        read_ptr += sizeof(T);
+
+        return detail::load<T>(ptr + where, big_endian_mode);
+    }
+
+    template <typename T>
+    inline T BufferView::read_le(size_t where) noexcept
+    {
+        return read<T>(where, true);
     }
 
     /** 
-     * @brief Checks if there are still enough data remaining that can be read
+     * @brief Read an array of values of type T from the view
      * 
-     * @param bytes  How many bytes need still to be read
+     * @param dst               where to write the values
+     * @param count             number of values to read
+     * @param big_endian_mode   byte order of the data, as with read
      * 
-     * @return true if size of the buffer is large enough for s bytes of data to be read, otherwise false
+     * @return true if the values were read, false if there is not enough data, in
+     *         which case nothing is read.
      */
-    inline bool Buffer::can_read(size_t bytes) const noexcept
+    template <typename T>
+    inline bool BufferView::read_array(T* dst, size_t count, bool big_endian_mode) noexcept
     {
-        if (size() < pos() + bytes)
+        static_assert(std::is_trivially_copyable<T>::value, "read_array requires trivially copyable type");
+
+        if (count > remaining() / sizeof(T))
             return false;
 
+        detail::copy_array<T>(reinterpret_cast<uint8_t*>(dst), ptr + read_ptr, count, big_endian_mode);
+        read_ptr += count * sizeof(T);
+
         return true;
-    };
+    }
 
-    /** 
-     * @brief Read a string that represents an integer
-     * 
-     * @return Integer of requested type represented by the text data read
-     *
-     */
+    //! read a variable-length integer, false if it cannot be read, see Buffer::read_varint
     template <typename T>
-    inline T Buffer::read_strval() const
+    inline bool BufferView::read_varint(T& value) noexcept
     {
-        size_t search, start;
-        uint8_t v;
+        uint64_t raw;
+        size_t used = detail::decode_varint(ptr + read_ptr, remaining(), raw);
 
-        for (search = read_ptr; search < size(); ++search)
-        {
-            if ((v != '0') && (v <= '9'))
-                continue;
-            break;
-        }
+        if (used == 0 || !detail::from_varint(raw, value))
+            return false;
 
-        char val[search - read_ptr];
+        read_ptr += used;
+        return true;
+    }
 
-        start = read_ptr;
-        while (read_ptr < search)
-        {
-            v = this->at(read_ptr);
-            val[read_ptr - start] = v;
-            if ((v >= '0') && (v <= '9'))
-            {
-                read_ptr++;
-                continue;
-            }
-            break;
-        }
-        return atoi(val);
+    //! read a variable-length integer, value-initialised T if it cannot be read
+    template <typename T>
+    inline T BufferView::read_varint() noexcept
+    {
+        T rval = T();
+        if (!read_varint(rval))
+            assert(0 && "invalid varint in a buffer view");
+
+        return rval;
     }
-            
-    /** 
-     * @brief Replace data in a buffer
-     * 
-     * @param loc   where in buffer the replaced data starts
-     * @param len   how many bytes of the data will be replaced
-     * @param src   source data buffer
-     */
-    inline void Buffer::replace(size_t loc, size_t len, const Buffer& src) noexcept
+
+    //! take a block of data for unchecked reading, see Buffer::read_block
+    inline BlockReader BufferView::read_block(size_t bytes) noexcept
     {
-        // make sure the buffer is large enough
-        if (size() - loc < len)
-            resize(loc + len);
+        if (!can_read(bytes))
+            return BlockReader();
 
-        // do not read more than we can
-        if (src.size() > len)
-            len = src.size();
+        BlockReader rval(ptr + read_ptr, bytes);
+        read_ptr += bytes;
 
-        memcpy(data() + loc, src.data(), len);
+        return rval;
     }
 
-    /** 
-     * @brief Read data of type T from the buffer
-     * 
-     * @param where the position where to read, if omitted, read_ptr is used as the position
-     * 
-     * @return Data read as type T.
-     */
+    //! parse a number written as text, see Buffer::read_number
     template <typename T>
-    inline T Buffer::read(size_t where, bool big_endian_mode) const noexcept
+    inline Result<T> BufferView::read_number()
     {
-        if (where == MUSH_DEFAULT_LOC)
-            where = read_ptr;
+        if (read_ptr >= length)
+            return Error("end of buffer");
 
-        T rval = *(T*)&(this->at(where));
+        T value;
+        const uint8_t* start = ptr + read_ptr;
+        const uint8_t* end = detail::parse_number(start, ptr + length, value);
 
-        if constexpr (std::is_pod<T>::value)
-            if ((big_endian() && !big_endian_mode) || (!big_endian() && big_endian_mode))
-                rval = endian_swap(rval);
+        if (end == nullptr)
+            return Error("not a number");
 
-        read_ptr += sizeof(T);
+        if (end == start)
+            return Error("out of range");
 
-        return rval;
+        read_ptr += end - start;
+        return value;
+    }
+
+    //! read a fixed-layout record described by a Schema, see Buffer::read_record
+    template <typename Schema>
+    inline bool BufferView::read_record(typename Schema::record_type& record, bool big_endian_mode) noexcept
+    {
+        if (!can_read(Schema::size))
+            return false;
+
+        Schema::load(ptr + read_ptr, record, big_endian_mode);
+        read_ptr += Schema::size;
+
+        return true;
+    }
+
+    // BlockReader implementations
+
+    inline void BlockReader::skip(size_t bytes) noexcept
+    {
+        assert(bytes <= length - offset && "skip past the end of a block");
+        offset += bytes;
     }
 
+    //! read data of type T from the block without bounds checking
     template <typename T>
-    inline T Buffer::read_le(size_t where) const noexcept
+    inline T BlockReader::read(bool big_endian_mode) noexcept
     {
-        return read<T>(where, true);
+        assert(sizeof(T) <= length - offset && "read past the end of a block");
+
+        T rval = detail::load<T>(ptr + offset, big_endian_mode);
+        offset += sizeof(T);
+
+        return rval;
     }
-            
-    /** 
-     * @brief Write data of type T to the end of the buffer
-     * 
-     * @param data  data to be written into the buffer
-     */
+
     template <typename T>
-    inline void Buffer::write(T&& data, bool big_endian_mode) noexcept
+    inline T BlockReader::read_le() noexcept
     {
-        if constexpr(std::is_pod<T>::value)
-        {
-            this->reserve(this->size() + sizeof(data));
+        return read<T>(true);
+    }
 
-            uint8_t* dataptr = nullptr;
+    //! read an array of values of type T from the block without bounds checking
+    template <typename T>
+    inline void BlockReader::read_array(T* dst, size_t count, bool big_endian_mode) noexcept
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "read_array requires trivially copyable type");
+        assert(count <= (length - offset) / sizeof(T) && "read past the end of a block");
 
-            if ((big_endian() && !big_endian_mode) || (!big_endian() && big_endian_mode))
-            {
-                T data_copy = endian_swap(std::forward<T>(data));
-                dataptr = (uint8_t*)&data_copy;
-                for (size_t it = 0; it < sizeof(data_copy); ++it)
-                    this->push_back(*(dataptr+it));
-                return;
-            } else {
-                dataptr = (uint8_t*)&data;
-            }
+        detail::copy_array<T>(reinterpret_cast<uint8_t*>(dst), ptr + offset, count, big_endian_mode);
+        offset += count * sizeof(T);
+    }
 
-            for (size_t it = 0; it < sizeof(data); ++it)
-                this->push_back(*(dataptr+it));
+    // RecordRange implementations
 
-        } else {
-            size_t start = size();
-            this->resize(size() + sizeof(T));
-            memcpy(this->data() + start, &data, sizeof(T)); 
+    inline RecordRange::iterator::iterator(const uint8_t* pos, const uint8_t* end, uint8_t delim) noexcept
+        : pos(pos), end(end), delim(delim)
+    {
+        if (pos != end)
+        {
+            next = detail::find_byte(pos, end - pos, delim);
+            record = BufferView(pos, next - pos - (next[-1] == delim ? 1 : 0));
         }
     }
-    
-    // Template specialisation for buffer writing
-    template<>
-    inline void Buffer::write(const Buffer& buf, bool big_endian_mode) noexcept
+
+    inline RecordRange::iterator& RecordRange::iterator::operator++() noexcept
     {
-        this->insert(std::end(*this), std::begin(buf), std::end(buf));
+        *this = iterator(next, end, delim);
+        return *this;
     }
 
-    template <typename T>
-    inline void Buffer::write_le(T&& data) noexcept
+    inline RecordRange::iterator RecordRange::begin() const noexcept
     {
-        write(std::forward<T>(data), true);
+        return iterator(data.begin(), data.end(), delim);
     }
 
-    /** 
-     * @brief Write series of bytes into the buffer
-     * 
-     * @param bytes  bytes to be written
-     */
-    template <typename... Ts>
-    inline void Buffer::write_bytes_impl(uint8_t byte, Ts... bytes) noexcept
+    inline RecordRange::iterator RecordRange::end() const noexcept
     {
-        write<uint8_t>(std::move(byte));
-        if constexpr (sizeof...(bytes) > 0)
-            write_bytes_impl(bytes...);
+        return iterator(data.end(), data.end(), delim);
     }
-    
-    template <typename... Ts>
-    inline void Buffer::write_bytes(Ts... bytes) noexcept
+
+    //! split data into records separated by delim, see RecordRange
+    inline RecordRange records(BufferView data, uint8_t delim) noexcept
     {
-        this->reserve(this->size() + sizeof...(bytes));
-        this->write_bytes_impl(bytes...);
+        return RecordRange(data, delim);
     }
 
     // HELPER STUFF IMPLEMENTATIONS
@@ -377,8 +1512,8 @@ namespace mush
         size = input.tellg();
         input.seekg(0, input.beg);
 
-        rval.resize(size);
-        input.read((char*)(&rval[0]), size);
+        rval.resize_uninitialized(size);
+        input.read((char*)(rval.data()), size);
         input.close();
 
         return rval;
@@ -386,32 +1521,18 @@ namespace mush
     
     namespace hashes
     {
-        // This voodoo is to find out whether size_t is 8 or 4 bytes long, it could be
-        // easily extended to different sizes, but for now this is enough.
-        template<typename T, bool is_x86_64 = size_t_x64()>
-        class Hash
-        {
-            public:
-            size_t operator()(const T&)
-            {
-                assert(0 && "unknown bit depth");
-            }
-        };
-
         // 64-bit buffer hash
-        template<>
-        class Hash<Buffer, true>
+        template<typename Allocator>
+        class Hash<BasicBuffer<Allocator>, true>
         {
             public:
-                size_t operator()(const Buffer& s) const noexcept
+                size_t operator()(const BasicBuffer<Allocator>& s) const noexcept
                 {
-                    if (s.size() == 0)
-                        return 0;
-
+                    // an empty buffer hashes to the offset basis, same as an empty BufferView
                     size_t hash  = 0xCBF29CE484222325;
                     const uint64_t prime = 0x100000001B3;
 
-                    uint8_t* bytep = (uint8_t*)s.getptr();
+                    const uint8_t* bytep = s.data();
 
                     for (size_t it = 0; it < s.size(); ++it)
                     {
@@ -423,19 +1544,16 @@ namespace mush
         };
 
         // 32-bit buffer hash
-        template<>
-        class Hash<Buffer, false>
+        template<typename Allocator>
+        class Hash<BasicBuffer<Allocator>, false>
         {
             public:
-                size_t operator()(const Buffer& s) const noexcept
+                size_t operator()(const BasicBuffer<Allocator>& s) const noexcept
                 {
-                    if (s.size() == 0)
-                        return 0;
-
                     size_t hash = 0x811C9DC5;
                     const uint32_t prime = 0x1000193;
 
-                    uint8_t* bytep = (uint8_t*)s.getptr();
+                    const uint8_t* bytep = s.data();
 
                     for (size_t it = 0; it < s.size(); ++it)
                     {
@@ -445,27 +1563,50 @@ namespace mush
                 return hash;
             }
         };
+
+        // word-at-a-time buffer hash, 64-bit result truncated to size_t
+        template<typename Allocator, bool is_x86_64>
+        class Hash<BasicBuffer<Allocator>, is_x86_64, wyhash>
+        {
+            public:
+                size_t operator()(const BasicBuffer<Allocator>& s) const noexcept
+                {
+                    return hash_bytes<wyhash>(s.data(), s.size());
+                }
+        };
+
+        template<bool is_x86_64, typename Algorithm>
+        class Hash<BufferView, is_x86_64, Algorithm>
+        {
+            public:
+                size_t operator()(const BufferView& s) const noexcept
+                {
+                    return hash_bytes<Algorithm>(s.data(), s.size());
+                }
+        };
     }
 }
 
 /*!
-Return hash of the string, note that the hash is not currently cached.
+Return hash of the buffer, note that the hash is not cached, wrap the buffer in
+hashes::Cached for that.
 
 \return FNV-1a hash.
 */
-inline size_t mush::Buffer::hash() const noexcept
+template <typename Allocator>
+inline size_t mush::BasicBuffer<Allocator>::hash() const noexcept
 {
-    hashes::Hash<Buffer> rval_hash;
+    hashes::Hash<BasicBuffer<Allocator>> rval_hash;
     return rval_hash(*this);
 }
 
 // Extend std::hash with our buffer type
 namespace std
 {
-    template<>
-    struct hash<mush::Buffer>
+    template<typename Allocator>
+    struct hash<mush::BasicBuffer<Allocator>>
     { 
-        size_t operator()(const mush::Buffer& __s) const noexcept
+        size_t operator()(const mush::BasicBuffer<Allocator>& __s) const noexcept
         {
             return __s.hash();
         }
@@ -0,0 +1,339 @@
+/*!
+ * \file buffer_chain.hpp
+ * \brief Contains the BufferChain class for building messages out of linked segments
+ * \author Jari Ronkainen
+ * \version 1.0
+ *
+ * BufferChain holds a sequence of segments that together form one logical buffer.
+ * Appending or prepending a Buffer moves it into the chain, and appending a BufferView
+ * only references the data, so building a large message never copies the payload.
+ * Length headers can be prepended once the size of the rest is known.
+ *
+ * The segments can be handed to writev() as iovecs, and flatten() merges them into one
+ * contiguous buffer only when that is really needed.
+ *
+ *  mush::BufferChain msg;
+ *  msg.append(std::move(payload));
+ *  mush::Buffer header;
+ *  header.write<uint32_t>(msg.size());
+ *  msg.prepend(std::move(header));
+ *  msg.write_to(fd);
+ */
+
+#ifndef MUSH_BUFFER_CHAIN
+#define MUSH_BUFFER_CHAIN
+
+#include <deque>
+
+#if defined(__has_include)
+#if __has_include(<sys/uio.h>)
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#define MUSH_BUFFER_CHAIN_IOVEC
+#endif
+#endif
+
+#include "buffer.hpp"
+
+namespace mush
+{
+    /**
+     * @brief Segmented buffer, a rope of Buffers and views
+     */
+    class BufferChain
+    {
+        private:
+            struct Segment
+            {
+                Buffer      owned;
+                BufferView  view;
+            };
+
+        public:
+            class const_iterator
+            {
+                public:
+                    typedef const_iterator                  self_type;
+                    typedef BufferView                      value_type;
+                    typedef const BufferView&               reference;
+                    typedef const BufferView*               pointer;
+                    typedef std::forward_iterator_tag       iterator_category;
+                    typedef std::ptrdiff_t                  difference_type;
+
+                    const_iterator(std::deque<Segment>::const_iterator it) : it(it) {}
+
+                    self_type& operator++()     { ++it; return *this; }
+                    self_type operator++(int)   { self_type i = *this; ++it; return i; }
+
+                    reference operator*() const { return it->view; }
+                    pointer operator->() const  { return &it->view; }
+
+                    bool operator==(const self_type& rhs) const { return it == rhs.it; }
+                    bool operator!=(const self_type& rhs) const { return it != rhs.it; }
+
+                private:
+                    std::deque<Segment>::const_iterator it;
+            };
+
+            BufferChain() = default;
+            BufferChain(BufferChain&&) = default;
+            BufferChain& operator=(BufferChain&&) = default;
+
+            BufferChain(const BufferChain&) = delete;
+            BufferChain& operator=(const BufferChain&) = delete;
+
+            void            append(Buffer&& segment);
+            void            append(BufferView segment);
+            void            append(BufferChain&& chain);
+
+            void            prepend(Buffer&& segment);
+            void            prepend(BufferView segment);
+
+            size_t          size() const noexcept;
+            size_t          segment_count() const noexcept;
+            bool            empty() const noexcept;
+            void            clear() noexcept;
+
+            const_iterator  begin() const noexcept;
+            const_iterator  end() const noexcept;
+
+            void            consume(size_t bytes);
+
+            BufferView      flatten();
+            Buffer          to_buffer() const;
+
+            #ifdef MUSH_BUFFER_CHAIN_IOVEC
+            size_t          to_iovec(struct iovec* iov, size_t max_count) const noexcept;
+            std::vector<struct iovec> iovecs() const;
+            bool            write_to(int fd);
+            #endif
+
+        private:
+            std::deque<Segment> segments;
+            size_t              total = 0;
+    };
+
+    // IMPLEMENTATIONS
+
+    //! move a buffer to the end of the chain, empty buffers are ignored
+    inline void BufferChain::append(Buffer&& segment)
+    {
+        if (segment.empty())
+            return;
+
+        total += segment.size();
+        segments.push_back(Segment{std::move(segment), BufferView()});
+        segments.back().view = BufferView(segments.back().owned);
+    }
+
+    //! reference data at the end of the chain, the data must outlive the chain
+    inline void BufferChain::append(BufferView segment)
+    {
+        if (segment.empty())
+            return;
+
+        total += segment.size();
+        segments.push_back(Segment{Buffer(), segment.subview(0)});
+    }
+
+    //! move all segments of another chain to the end of this one
+    inline void BufferChain::append(BufferChain&& chain)
+    {
+        for (Segment& segment : chain.segments)
+            segments.push_back(std::move(segment));
+
+        total += chain.total;
+        chain.clear();
+    }
+
+    //! move a buffer to the start of the chain, e.g. a length header
+    inline void BufferChain::prepend(Buffer&& segment)
+    {
+        if (segment.empty())
+            return;
+
+        total += segment.size();
+        segments.push_front(Segment{std::move(segment), BufferView()});
+        segments.front().view = BufferView(segments.front().owned);
+    }
+
+    //! reference data at the start of the chain, the data must outlive the chain
+    inline void BufferChain::prepend(BufferView segment)
+    {
+        if (segment.empty())
+            return;
+
+        total += segment.size();
+        segments.push_front(Segment{Buffer(), segment.subview(0)});
+    }
+
+    //! total number of bytes in the chain
+    inline size_t BufferChain::size() const noexcept { return total; }
+
+    inline size_t BufferChain::segment_count() const noexcept { return segments.size(); }
+    inline bool BufferChain::empty() const noexcept { return total == 0; }
+
+    inline void BufferChain::clear() noexcept
+    {
+        segments.clear();
+        total = 0;
+    }
+
+    inline BufferChain::const_iterator BufferChain::begin() const noexcept { return const_iterator(segments.begin()); }
+    inline BufferChain::const_iterator BufferChain::end() const noexcept { return const_iterator(segments.end()); }
+
+    /**
+     * @brief Drop bytes from the start of the chain
+     *
+     * Used after a partial write, fully consumed segments are released.
+     *
+     * @param bytes number of bytes to drop
+     */
+    inline void BufferChain::consume(size_t bytes)
+    {
+        while (bytes != 0 && !segments.empty())
+        {
+            Segment& front = segments.front();
+
+            if (bytes < front.view.size())
+            {
+                front.view = front.view.subview(bytes);
+                total -= bytes;
+                return;
+            }
+
+            bytes -= front.view.size();
+            total -= front.view.size();
+            segments.pop_front();
+        }
+    }
+
+    /**
+     * @brief Get the whole chain as contiguous data
+     *
+     * If the chain has more than one segment they are merged into a single buffer
+     * first, which then replaces them, so repeated calls copy only once.
+     *
+     * @return view to the data, valid until the chain is modified
+     */
+    inline BufferView BufferChain::flatten()
+    {
+        if (segments.empty())
+            return BufferView();
+
+        if (segments.size() > 1)
+        {
+            Buffer merged = to_buffer();
+            segments.clear();
+            segments.push_back(Segment{std::move(merged), BufferView()});
+            segments.back().view = BufferView(segments.back().owned);
+        }
+
+        return segments.front().view;
+    }
+
+    //! copy the chain into a new buffer, leaving the chain as it is
+    inline Buffer BufferChain::to_buffer() const
+    {
+        Buffer rval;
+        uint8_t* dst = rval.append_uninitialized(total);
+
+        for (const Segment& segment : segments)
+        {
+            memcpy(dst, segment.view.data(), segment.view.size());
+            dst += segment.view.size();
+        }
+
+        return rval;
+    }
+
+    #ifdef MUSH_BUFFER_CHAIN_IOVEC
+    /**
+     * @brief Fill iovec structures for scatter/gather IO
+     *
+     * @param iov       destination array
+     * @param max_count size of the destination array
+     *
+     * @return number of iovecs filled, at most max_count
+     */
+    inline size_t BufferChain::to_iovec(struct iovec* iov, size_t max_count) const noexcept
+    {
+        size_t count = 0;
+        for (const Segment& segment : segments)
+        {
+            if (count == max_count)
+                break;
+
+            iov[count].iov_base = const_cast<uint8_t*>(segment.view.data());
+            iov[count].iov_len = segment.view.size();
+            ++count;
+        }
+        return count;
+    }
+
+    //! iovecs for all segments
+    inline std::vector<struct iovec> BufferChain::iovecs() const
+    {
+        std::vector<struct iovec> rval(segments.size());
+        to_iovec(rval.data(), rval.size());
+        return rval;
+    }
+
+    /**
+     * @brief Write the whole chain to a file descriptor with writev
+     *
+     * Written data is consumed from the chain, so on failure the chain holds what
+     * still remains to be written.
+     *
+     * @param fd    file descriptor
+     *
+     * @return true if everything was written, false on error
+     */
+    inline bool BufferChain::write_to(int fd)
+    {
+        constexpr size_t batch = 64;
+        struct iovec iov[batch];
+
+        while (!empty())
+        {
+            size_t count = to_iovec(iov, batch);
+            ssize_t written = ::writev(fd, iov, static_cast<int>(count));
+
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+
+            consume(static_cast<size_t>(written));
+        }
+
+        return true;
+    }
+    #endif
+}
+
+#endif
+/*
+ Copyright (c) 2017 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
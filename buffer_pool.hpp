@@ -0,0 +1,357 @@
+/*!
+ * \file buffer_pool.hpp
+ * \brief Contains the BufferPool class for recycling Buffers together with their memory
+ * \author Jari Ronkainen
+ * \version 1.0
+ *
+ * BufferPool keeps released Buffers around with their capacity intact and hands them out
+ * again from acquire(), so code that creates and destroys lots of buffers does not free
+ * and re-allocate the same memory over and over again.
+ *
+ * Buffers are kept in power-of-two size classes by capacity.  Each thread has a small
+ * cache of its own in front of the shared lists, so most acquire/release pairs never take
+ * the lock.  The pool is thread-safe, a buffer may be released on a different thread than
+ * it was acquired on.
+ *
+ *  mush::BufferPool pool;
+ *  mush::Buffer buf = pool.acquire(4096);
+ *  ...
+ *  pool.release(std::move(buf));
+ */
+
+#ifndef MUSH_BUFFER_POOL
+#define MUSH_BUFFER_POOL
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+#include "buffer.hpp"
+
+namespace mush
+{
+    namespace detail
+    {
+        constexpr static size_t POOL_MIN_CLASS_LOG = 8;
+        constexpr static size_t POOL_MAX_CLASS_LOG = 24;
+        constexpr static size_t POOL_CLASS_COUNT = POOL_MAX_CLASS_LOG - POOL_MIN_CLASS_LOG + 1;
+
+        // shared part of a pool, outlives the pool while thread caches still refer to it
+        struct PoolCentral
+        {
+            std::mutex          mutex;
+            std::vector<Buffer> classes[POOL_CLASS_COUNT];
+
+            size_t              max_per_class;
+            size_t              cache_size;
+            uint64_t            id;
+
+            std::atomic<size_t> hits = 0;
+            std::atomic<size_t> misses = 0;
+        };
+
+        struct PoolThreadCache
+        {
+            std::weak_ptr<PoolCentral>  owner;
+            uint64_t                    id = 0;
+            std::vector<Buffer>         classes[POOL_CLASS_COUNT];
+
+            PoolThreadCache() = default;
+            PoolThreadCache(PoolThreadCache&&) = default;
+           ~PoolThreadCache();
+        };
+    }
+
+    /**
+     * @brief Thread-safe pool of Buffers with retained capacity
+     */
+    class BufferPool
+    {
+        public:
+            //! smallest capacity that is pooled
+            constexpr static size_t MIN_CAPACITY = size_t(1) << detail::POOL_MIN_CLASS_LOG;
+
+            //! largest capacity that is pooled, larger buffers are allocated and freed normally
+            constexpr static size_t MAX_CAPACITY = size_t(1) << detail::POOL_MAX_CLASS_LOG;
+
+            struct Stats
+            {
+                size_t  hits;
+                size_t  misses;
+            };
+
+            BufferPool(size_t max_per_class = 64, size_t cache_size = 4);
+           ~BufferPool();
+
+            BufferPool(const BufferPool&) = delete;
+            BufferPool& operator=(const BufferPool&) = delete;
+
+            Buffer          acquire(size_t capacity);
+            void            release(Buffer&& buffer);
+
+            Stats           stats() const noexcept;
+            void            reset_stats() noexcept;
+
+            void            trim();
+
+        private:
+            static size_t   class_for_request(size_t bytes) noexcept;
+            static size_t   class_for_capacity(size_t capacity) noexcept;
+
+            detail::PoolThreadCache& thread_cache();
+
+            std::shared_ptr<detail::PoolCentral> central;
+    };
+
+    // IMPLEMENTATIONS
+
+    namespace detail
+    {
+        // give the buffers of a thread back to the pool when the thread exits
+        inline PoolThreadCache::~PoolThreadCache()
+        {
+            std::shared_ptr<PoolCentral> pool = owner.lock();
+            if (!pool)
+                return;
+
+            std::unique_lock<std::mutex> lock(pool->mutex);
+            for (size_t i = 0; i < POOL_CLASS_COUNT; ++i)
+                for (Buffer& buffer : classes[i])
+                    if (pool->classes[i].size() < pool->max_per_class)
+                        pool->classes[i].push_back(std::move(buffer));
+        }
+
+        inline std::unordered_map<const PoolCentral*, PoolThreadCache>& pool_thread_caches()
+        {
+            thread_local std::unordered_map<const PoolCentral*, PoolThreadCache> caches;
+            return caches;
+        }
+
+        // the cache used last on this thread, to skip the map lookup
+        struct PoolLastUsed
+        {
+            const PoolCentral*  pool = nullptr;
+            PoolThreadCache*    cache = nullptr;
+        };
+
+        inline PoolLastUsed& pool_last_used() noexcept
+        {
+            thread_local PoolLastUsed last;
+            return last;
+        }
+
+        inline uint64_t next_pool_id() noexcept
+        {
+            static std::atomic<uint64_t> counter = 0;
+            return ++counter;
+        }
+
+        // hand over a buffer with the same storage and a fresh read position
+        inline Buffer take_storage(Buffer& buffer) noexcept
+        {
+            Buffer rval;
+            static_cast<Buffer::storage_type&>(rval).swap(buffer);
+            rval.clear();
+            return rval;
+        }
+    }
+
+    /**
+     * @brief Create a pool
+     *
+     * @param max_per_class how many buffers of each size class the shared lists keep,
+     *                      buffers released beyond that are freed
+     * @param cache_size    how many buffers of each size class each thread keeps to itself
+     */
+    inline BufferPool::BufferPool(size_t max_per_class, size_t cache_size)
+        : central(std::make_shared<detail::PoolCentral>())
+    {
+        central->max_per_class = max_per_class;
+        central->cache_size = cache_size;
+        central->id = detail::next_pool_id();
+    }
+
+    inline BufferPool::~BufferPool()
+    {
+        // thread caches of other threads notice the pool is gone from the expired owner
+        detail::PoolLastUsed& last = detail::pool_last_used();
+        if (last.pool == central.get())
+            last = detail::PoolLastUsed();
+
+        detail::pool_thread_caches().erase(central.get());
+    }
+
+    // smallest class with capacity of at least bytes
+    inline size_t BufferPool::class_for_request(size_t bytes) noexcept
+    {
+        size_t index = 0;
+        while ((MIN_CAPACITY << index) < bytes)
+            ++index;
+        return index;
+    }
+
+    // largest class whose size the capacity covers
+    inline size_t BufferPool::class_for_capacity(size_t capacity) noexcept
+    {
+        size_t index = 0;
+        while (index + 1 < detail::POOL_CLASS_COUNT && (MIN_CAPACITY << (index + 1)) <= capacity)
+            ++index;
+        return index;
+    }
+
+    inline detail::PoolThreadCache& BufferPool::thread_cache()
+    {
+        detail::PoolLastUsed& last = detail::pool_last_used();
+        if (last.pool == central.get() && last.cache->id == central->id)
+            return *last.cache;
+
+        detail::PoolThreadCache& cache = detail::pool_thread_caches()[central.get()];
+
+        // a new cache, or a stale one left by an earlier pool at the same address
+        if (cache.id != central->id)
+        {
+            for (std::vector<Buffer>& list : cache.classes)
+                list.clear();
+            cache.owner = central;
+            cache.id = central->id;
+        }
+
+        last.pool = central.get();
+        last.cache = &cache;
+
+        return cache;
+    }
+
+    /**
+     * @brief Get an empty buffer with room for at least capacity bytes
+     *
+     * The capacity is rounded up to the next size class.  Counts as a hit if a pooled
+     * buffer was reused and as a miss if a new one had to be allocated.
+     */
+    inline Buffer BufferPool::acquire(size_t capacity)
+    {
+        if (capacity > MAX_CAPACITY)
+        {
+            central->misses.fetch_add(1, std::memory_order_relaxed);
+
+            Buffer rval;
+            rval.reserve(capacity);
+            return rval;
+        }
+
+        size_t index = class_for_request(capacity);
+        std::vector<Buffer>& local = thread_cache().classes[index];
+
+        if (local.empty())
+        {
+            // refill half of the thread cache at once to take the lock less often
+            std::unique_lock<std::mutex> lock(central->mutex);
+            std::vector<Buffer>& shared = central->classes[index];
+
+            size_t count = std::min(shared.size(), central->cache_size / 2 + 1);
+            for (size_t i = 0; i < count; ++i)
+            {
+                local.push_back(std::move(shared.back()));
+                shared.pop_back();
+            }
+        }
+
+        if (!local.empty())
+        {
+            central->hits.fetch_add(1, std::memory_order_relaxed);
+
+            Buffer rval = std::move(local.back());
+            local.pop_back();
+            return rval;
+        }
+
+        central->misses.fetch_add(1, std::memory_order_relaxed);
+
+        Buffer rval;
+        rval.reserve(MIN_CAPACITY << index);
+        return rval;
+    }
+
+    /**
+     * @brief Give a buffer back to the pool
+     *
+     * The contents are discarded, the memory is kept for later acquire() calls.  Buffers
+     * smaller than MIN_CAPACITY or larger than MAX_CAPACITY are simply freed.
+     */
+    inline void BufferPool::release(Buffer&& buffer)
+    {
+        size_t capacity = buffer.capacity();
+        if (capacity < MIN_CAPACITY || capacity > MAX_CAPACITY * 2)
+        {
+            Buffer().swap(buffer);
+            return;
+        }
+
+        size_t index = class_for_capacity(capacity);
+        std::vector<Buffer>& local = thread_cache().classes[index];
+
+        if (local.size() >= central->cache_size)
+        {
+            // thread cache full, move half of it to the shared list
+            std::unique_lock<std::mutex> lock(central->mutex);
+            std::vector<Buffer>& shared = central->classes[index];
+
+            while (local.size() > central->cache_size / 2)
+            {
+                if (shared.size() < central->max_per_class)
+                    shared.push_back(std::move(local.back()));
+                local.pop_back();
+            }
+        }
+
+        local.push_back(detail::take_storage(buffer));
+    }
+
+    //! hit and miss counts of acquire() since creation or reset_stats()
+    inline BufferPool::Stats BufferPool::stats() const noexcept
+    {
+        return Stats{ central->hits.load(std::memory_order_relaxed),
+                      central->misses.load(std::memory_order_relaxed) };
+    }
+
+    inline void BufferPool::reset_stats() noexcept
+    {
+        central->hits = 0;
+        central->misses = 0;
+    }
+
+    //! free the buffers in the shared lists and in the cache of the calling thread
+    inline void BufferPool::trim()
+    {
+        for (std::vector<Buffer>& list : thread_cache().classes)
+            std::vector<Buffer>().swap(list);
+
+        std::unique_lock<std::mutex> lock(central->mutex);
+        for (std::vector<Buffer>& list : central->classes)
+            std::vector<Buffer>().swap(list);
+    }
+}
+
+#endif
+/*
+ Copyright (c) 2017 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,390 @@
+/*!
+ * \file chunk_reader.hpp
+ * \brief Contains the ChunkReader class for streaming files in fixed-size chunks
+ * \author Jari Ronkainen
+ * \version 1.0
+ *
+ * ChunkReader reads a file in fixed-size chunks on a background thread, keeping a
+ * configurable number of chunks read ahead of the consumer.  Processing of the data
+ * (decompression, checksums, parsing) then happens while the next chunks are being
+ * read from the disk.
+ *
+ * The chunks can be taken out one by one with next_chunk(), or the reader can be used
+ * like a Buffer through read<T>(), copy_bytes() and copy_until(), in which case the
+ * chunk boundaries are invisible to the caller.
+ */
+
+#ifndef MUSH_CHUNK_READER
+#define MUSH_CHUNK_READER
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "buffer.hpp"
+
+namespace mush
+{
+    /**
+     * @brief Streams a file in chunks with background read-ahead
+     */
+    class ChunkReader
+    {
+        public:
+            constexpr static size_t DEFAULT_CHUNK_SIZE = 1 << 20;
+            constexpr static size_t DEFAULT_DEPTH = 3;
+
+            ChunkReader(const char* filename,
+                        size_t chunk_size = DEFAULT_CHUNK_SIZE,
+                        size_t depth = DEFAULT_DEPTH);
+           ~ChunkReader();
+
+            ChunkReader(const ChunkReader&) = delete;
+            ChunkReader& operator=(const ChunkReader&) = delete;
+
+            bool            is_open() const noexcept;
+            explicit        operator bool() const noexcept;
+            bool            failed();
+
+            bool            eof();
+            size_t          pos() const noexcept;
+
+            Buffer          next_chunk();
+            void            recycle(Buffer&& chunk);
+
+            size_t          read_bytes(uint8_t* dst, size_t len);
+            size_t          skip(size_t len);
+
+            Buffer          copy_bytes(size_t len);
+            Buffer          copy_until(const uint8_t delim);
+
+            template <typename T>
+            T read(bool big_endian_mode = false);
+
+            template <typename T>
+            T read_le();
+
+        private:
+            void            producer();
+            bool            fetch();
+
+            std::ifstream           input;
+            std::thread             worker;
+
+            std::mutex              mutex;
+            std::condition_variable available;
+            std::condition_variable space;
+
+            std::deque<Buffer>      ready;
+            std::vector<Buffer>     spare;
+
+            Buffer                  current;
+            BufferView              cursor;
+
+            size_t                  chunk_size;
+            size_t                  depth;
+            size_t                  consumed = 0;
+
+            bool                    opened = false;
+            bool                    finished = false;
+            bool                    read_error = false;
+            bool                    stop = false;
+    };
+
+    // IMPLEMENTATIONS
+
+    /**
+     * @brief Open a file and start reading it in the background
+     *
+     * @param filename      file name
+     * @param chunk_size    size of a single chunk in bytes
+     * @param depth         how many chunks are kept read ahead, 2 for double buffering,
+     *                      3 for triple buffering and so on
+     */
+    inline ChunkReader::ChunkReader(const char* filename, size_t chunk_size, size_t depth)
+        : input(filename, std::ifstream::binary),
+          chunk_size(chunk_size == 0 ? 1 : chunk_size),
+          depth(depth == 0 ? 1 : depth)
+    {
+        if (!input)
+            return;
+
+        opened = true;
+        worker = std::thread([this]{ producer(); });
+    }
+
+    inline ChunkReader::~ChunkReader()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stop = true;
+        }
+        space.notify_all();
+
+        if (worker.joinable())
+            worker.join();
+    }
+
+    inline bool ChunkReader::is_open() const noexcept { return opened; }
+    inline ChunkReader::operator bool() const noexcept { return opened; }
+
+    //! check if reading the file failed before reaching its end
+    inline bool ChunkReader::failed()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return read_error;
+    }
+
+    //! return the position in the file, counting all data handed out so far
+    inline size_t ChunkReader::pos() const noexcept
+    {
+        return consumed + cursor.pos();
+    }
+
+    // background thread, fills chunks until the queue is full or the file ends
+    inline void ChunkReader::producer()
+    {
+        while (true)
+        {
+            Buffer chunk;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                space.wait(lock, [&]{ return stop || ready.size() < depth; });
+
+                if (stop)
+                    return;
+
+                if (!spare.empty())
+                {
+                    chunk = std::move(spare.back());
+                    spare.pop_back();
+                }
+            }
+
+            chunk.resize_uninitialized(chunk_size);
+            input.read(reinterpret_cast<char*>(chunk.data()), chunk_size);
+
+            size_t got = static_cast<size_t>(input.gcount());
+            chunk.resize(got);
+
+            bool end = (got < chunk_size) || input.peek() == std::ifstream::traits_type::eof();
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (got != 0)
+                    ready.push_back(std::move(chunk));
+
+                if (end)
+                {
+                    finished = true;
+                    read_error = input.bad();
+                }
+            }
+            available.notify_one();
+
+            if (end)
+                return;
+        }
+    }
+
+    // replace the current chunk with the next one, false if there is no more data
+    inline bool ChunkReader::fetch()
+    {
+        if (!opened)
+            return false;
+
+        std::unique_lock<std::mutex> lock(mutex);
+
+        consumed += cursor.pos();
+
+        if (current.capacity() != 0 && spare.size() < depth)
+            spare.push_back(std::move(current));
+
+        current = Buffer();
+        cursor = BufferView();
+
+        available.wait(lock, [&]{ return !ready.empty() || finished; });
+
+        if (ready.empty())
+            return false;
+
+        current = std::move(ready.front());
+        ready.pop_front();
+        cursor = current.view();
+
+        lock.unlock();
+        space.notify_one();
+
+        return true;
+    }
+
+    //! check if all data has been consumed, blocks until that is known
+    inline bool ChunkReader::eof()
+    {
+        while (cursor.remaining() == 0)
+            if (!fetch())
+                return true;
+
+        return false;
+    }
+
+    /**
+     * @brief Take the next chunk out of the reader
+     *
+     * If the current chunk has been partially read with the read functions, only the
+     * unread part is returned.  Pass the chunk back with recycle() once done with it
+     * to let the reader reuse its memory.
+     *
+     * @return Next chunk of data, empty at the end of the file
+     */
+    inline Buffer ChunkReader::next_chunk()
+    {
+        if (eof())
+            return Buffer();
+
+        Buffer rval = std::move(current);
+        if (cursor.pos() != 0)
+            rval.erase(rval.begin(), rval.begin() + cursor.pos());
+
+        consumed += cursor.size();
+        current = Buffer();
+        cursor = BufferView();
+
+        return rval;
+    }
+
+    //! give memory of a chunk back to the reader for reuse
+    inline void ChunkReader::recycle(Buffer&& chunk)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (spare.size() < depth)
+        {
+            chunk.clear();
+            spare.push_back(std::move(chunk));
+        }
+    }
+
+    /**
+     * @brief Read raw bytes, crossing chunk boundaries as needed
+     *
+     * @param dst   destination, must have room for len bytes
+     * @param len   number of bytes to read
+     *
+     * @return number of bytes actually read, less than len only at the end of the file
+     */
+    inline size_t ChunkReader::read_bytes(uint8_t* dst, size_t len)
+    {
+        size_t done = 0;
+        while (done < len && !eof())
+        {
+            size_t n = std::min(len - done, cursor.remaining());
+            memcpy(dst + done, cursor.getptr(), n);
+            cursor.skip(n);
+            done += n;
+        }
+        return done;
+    }
+
+    //! skip bytes, returns number of bytes actually skipped
+    inline size_t ChunkReader::skip(size_t len)
+    {
+        size_t done = 0;
+        while (done < len && !eof())
+        {
+            size_t n = std::min(len - done, cursor.remaining());
+            cursor.skip(n);
+            done += n;
+        }
+        return done;
+    }
+
+    /**
+     * @brief Read data into a new buffer
+     *
+     * @param len Number of bytes to be read
+     *
+     * @return A new buffer containing up to len bytes of data.
+     */
+    inline Buffer ChunkReader::copy_bytes(size_t len)
+    {
+        Buffer rval;
+        while (rval.size() < len && !eof())
+        {
+            BufferView part = cursor.copy_bytes(std::min(len - rval.size(), cursor.remaining()));
+            rval.insert(rval.end(), part.begin(), part.end());
+        }
+        return rval;
+    }
+
+    /**
+     * @brief Read data until a byte is met
+     *
+     * @param delim byte ending the search
+     *
+     * @return A new buffer holding all the values up to and including the delim byte.
+     */
+    inline Buffer ChunkReader::copy_until(const uint8_t delim)
+    {
+        Buffer rval;
+        while (!eof())
+        {
+            BufferView part = cursor.copy_until(delim);
+            rval.insert(rval.end(), part.begin(), part.end());
+
+            if (!part.empty() && part[part.size() - 1] == delim)
+                break;
+        }
+        return rval;
+    }
+
+    /**
+     * @brief Read data of type T from the stream
+     *
+     * @return Data read as type T, or value-initialised T if the file ends before
+     *         enough data could be read
+     */
+    template <typename T>
+    inline T ChunkReader::read(bool big_endian_mode)
+    {
+        if (cursor.can_read(sizeof(T)))
+            return cursor.read<T>(MUSH_DEFAULT_LOC, big_endian_mode);
+
+        // value is split between chunks
+        uint8_t bytes[sizeof(T)];
+        if (read_bytes(bytes, sizeof(T)) != sizeof(T))
+            return T();
+
+        return detail::load<T>(bytes, big_endian_mode);
+    }
+
+    template <typename T>
+    inline T ChunkReader::read_le()
+    {
+        return read<T>(true);
+    }
+}
+
+#endif
+/*
+ Copyright (c) 2017 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
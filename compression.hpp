@@ -1,12 +1,11 @@
 #ifndef MUSH_COMPRESSION
 #define MUSH_COMPRESSION
 
-#include "buffer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
 
-// Defines for FastLZ
-#define LZF_HASH_LOG  12
-#define LZF_HASH_SIZE (1<< LZF_HASH_LOG)
-#define LZF_HASH_MASK  (LZF_HASH_SIZE-1)
+#include "buffer.hpp"
 
 namespace mush
 {
@@ -16,8 +15,445 @@ namespace mush
         constexpr uint32_t MAX_LEN = 264;
         constexpr uint32_t MAX_DISTANCE = 8192;
 
-        Buffer compress(const Buffer& input);
+        //! most bytes a stream can decode to per input byte, a 3 byte back reference of MAX_LEN
+        constexpr uint32_t MAX_EXPANSION = MAX_LEN / 3;
+
+        /*
+            Compression levels, both produce the same format and use the same decoder.
+
+              fast    one candidate per hash slot, 4096 slot table on the stack
+              high    hash chains over the whole 8 KiB window with lazy matching,
+                      slower but finds longer matches
+        */
+        enum class Level
+        {
+            fast,
+            high,
+        };
+
+        constexpr uint32_t FAST_HASH_LOG = 12;
+        constexpr uint32_t HIGH_HASH_LOG = 15;
+
+        //! how many chain entries the high level tries for each position
+        constexpr uint32_t HIGH_CHAIN_DEPTH = 16;
+
+        //! dictionary size train_dictionary() aims for, leaves messages up to 4 KiB the
+        //! whole dictionary within reach
+        constexpr size_t DEFAULT_DICTIONARY_SIZE = 4096;
+
+        /**
+         * @brief Preset dictionary for compressing small inputs that share content
+         *
+         * Back references may reach into the dictionary as if it came right before the
+         * input, so both ends have to use the same dictionary.  Only the last
+         * MAX_DISTANCE bytes are within reach and kept.  The hash table for the fast level
+         * is built once here and copied for each input.  A dictionary is not modified by
+         * compression and can be shared by threads.
+         */
+        class Dictionary
+        {
+            public:
+                Dictionary() = default;
+                Dictionary(const uint8_t* data, size_t len);
+                explicit Dictionary(const Buffer& content);
+
+                const uint8_t*  data() const noexcept;
+                size_t          size() const noexcept;
+
+            private:
+                friend class Context;
+
+                Buffer                  content;
+                std::vector<uint32_t>   fast_table;
+                uint64_t                id = 0;
+        };
+
+        /**
+         * @brief Reusable compression state
+         *
+         * Owns the match finder tables, so compressing many small inputs does not
+         * allocate and clear them on every call.  The tables hold offsets from a running
+         * base, and entries left by earlier inputs are recognised by being below the
+         * current base instead of being cleared.  A context must not be used by several
+         * threads at once.
+         */
+        class Context
+        {
+            public:
+                Context();
+
+                size_t      compress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity,
+                                          Level level = Level::fast);
+                size_t      decompress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity);
+
+                // With a preset dictionary
+                size_t      compress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity,
+                                          const Dictionary& dictionary, Level level = Level::fast);
+                size_t      decompress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity,
+                                            const Dictionary& dictionary);
+
+            private:
+                uint32_t    claim(size_t len);
+
+                std::unique_ptr<uint32_t[]> fast_table;
+                std::unique_ptr<uint32_t[]> high_head;
+                std::unique_ptr<uint32_t[]> high_chain;
+
+                uint32_t    base = 1;
+
+                // dictionary followed by the input, the dictionary part is kept between
+                // calls with the same dictionary
+                Buffer      window;
+                uint64_t    window_id = 0;
+                std::unique_ptr<uint32_t[]> dictionary_table;
+        };
+
+        //! largest raw LZF stream compress_into() can produce from len bytes
+        constexpr size_t compress_bound(size_t len) noexcept
+        {
+            return len + len / MAX_COPY + 2;
+        }
+
+        //! extra output room that lets the decoder copy in whole 16 and 32 byte steps
+        constexpr size_t DECOMPRESS_SLACK = 32;
+
+        /**
+         * @brief Output capacity for decompressing raw_size bytes at full speed
+         *
+         * The decoder writes whole words past the end of a copy while the output has room
+         * for it and falls back to exact copies near the end of the capacity, so any
+         * capacity of at least raw_size works, this one just never slows down.
+         */
+        constexpr size_t decompress_bound(size_t raw_size) noexcept
+        {
+            return raw_size + DECOMPRESS_SLACK;
+        }
+
+        // Raw LZF streams without a header, using a context kept per thread
+        size_t compress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity, Level level = Level::fast);
+        size_t decompress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity);
+
+        size_t compress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity,
+                             const Dictionary& dictionary, Level level = Level::fast);
+        size_t decompress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity,
+                               const Dictionary& dictionary);
+
+        Buffer compress(const Buffer& input, Level level = Level::fast);
         Buffer uncompress(const Buffer& input);
+
+        // Same format as compress() and uncompress(), with a preset dictionary
+        Buffer compress(const Buffer& input, const Dictionary& dictionary, Level level = Level::fast);
+        Result<Buffer> uncompress(const Buffer& input, const Dictionary& dictionary);
+
+        Dictionary train_dictionary(const std::vector<Buffer>& samples, size_t size = DEFAULT_DICTIONARY_SIZE);
+
+        // Write into output, replacing its contents but keeping its capacity,
+        // uncompress() returns false and leaves output empty for corrupt input
+        void compress(const Buffer& input, Buffer& output, Level level = Level::fast);
+        bool uncompress(const Buffer& input, Buffer& output);
+
+        /*
+            Framed format, all integers little-endian:
+
+              magic               4 bytes  "MLZF"
+              version             1 byte
+              blocks:
+                type              1 byte   BLOCK_STORED, BLOCK_LZF or BLOCK_LZF_HUFFMAN
+                raw size          4 bytes
+                stored size       4 bytes
+                data              stored size bytes
+              end marker:
+                type              1 byte   BLOCK_END
+                total raw size    8 bytes
+
+            Blocks are compressed independently and are at most MAX_BLOCK_SIZE bytes
+            uncompressed, so both ends need memory for one block only.  BLOCK_LZF_HUFFMAN
+            blocks hold LZF data that has been further Huffman coded, see huffman::encode.
+        */
+        constexpr uint8_t  FRAME_MAGIC[4] = { 'M', 'L', 'Z', 'F' };
+        constexpr uint8_t  FRAME_VERSION = 1;
+        constexpr size_t   FRAME_HEADER_SIZE = 5;
+        constexpr size_t   BLOCK_HEADER_SIZE = 9;
+        constexpr size_t   END_MARKER_SIZE = 9;
+
+        constexpr uint8_t  BLOCK_STORED = 0x00;
+        constexpr uint8_t  BLOCK_LZF = 0x01;
+        constexpr uint8_t  BLOCK_LZF_HUFFMAN = 0x02;
+        constexpr uint8_t  BLOCK_END = 0xff;
+
+        //! entropy coding stage applied on top of LZF blocks
+        enum class Entropy
+        {
+            none,
+            huffman,
+        };
+
+        constexpr size_t   DEFAULT_BLOCK_SIZE = 1 << 16;
+        constexpr size_t   MAX_BLOCK_SIZE = 1 << 24;
+
+        /**
+         * @brief Streaming compressor producing the framed format
+         *
+         * Input can be given in pieces of any size, complete blocks are appended to the
+         * output as soon as they fill up.  finish() writes the last partial block and
+         * the end marker.
+         */
+        class Compressor
+        {
+            public:
+                Compressor(size_t block_size = DEFAULT_BLOCK_SIZE, Level level = Level::fast,
+                           Entropy entropy = Entropy::none);
+
+                void        write(const uint8_t* data, size_t len, Buffer& output);
+                void        write(const Buffer& input, Buffer& output);
+                void        finish(Buffer& output);
+
+                uint64_t    total_in() const noexcept;
+
+            private:
+                void        emit_block(const uint8_t* data, size_t len, Buffer& output);
+
+                Context     context;
+                Buffer      pending;
+                size_t      block_size;
+                Level       level;
+                Entropy     entropy;
+                uint64_t    total = 0;
+                bool        started = false;
+        };
+
+        /**
+         * @brief Streaming decompressor for the framed format
+         *
+         * Input can be given in pieces of any size, the data of each block is appended
+         * to the output once the whole block has arrived.
+         */
+        class Decompressor
+        {
+            public:
+                bool        write(const uint8_t* data, size_t len, Buffer& output);
+                bool        write(const Buffer& input, Buffer& output);
+
+                bool        finished() const noexcept;
+                bool        failed() const noexcept;
+
+                uint64_t    total_out() const noexcept;
+
+            private:
+                bool        fail() noexcept;
+
+                Buffer      pending;
+                size_t      consumed = 0;
+                uint64_t    total = 0;
+                bool        header_read = false;
+                bool        done = false;
+                bool        error = false;
+        };
+
+        // Whole buffer to and from the framed format
+        Buffer compress_framed(const Buffer& input, size_t block_size = DEFAULT_BLOCK_SIZE, Level level = Level::fast,
+                               Entropy entropy = Entropy::none);
+        Result<Buffer> uncompress_framed(const Buffer& input);
+    }
+
+    namespace lz4
+    {
+        /*
+            LZ4 block format, as described in lz4_Block_format.md of the reference
+            implementation, without the frame format around it.
+        */
+        constexpr uint32_t HASH_LOG = 12;
+        constexpr uint32_t MIN_MATCH = 4;
+        constexpr uint32_t MAX_DISTANCE = 65535;
+
+        //! the last match has to start at least this many bytes before the end of the block
+        constexpr uint32_t MF_LIMIT = 12;
+
+        //! the last bytes of a block are always literals
+        constexpr uint32_t LAST_LITERALS = 5;
+
+        constexpr size_t   DECOMPRESS_SLACK = 32;
+
+        /**
+         * @brief Reusable LZ4 compression state
+         *
+         * Same idea as lzf::Context, the hash table holds offsets from a running base so
+         * it is never cleared between inputs.
+         */
+        class Context
+        {
+            public:
+                Context();
+
+                size_t      compress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity);
+
+            private:
+                uint32_t    claim(size_t len);
+
+                std::unique_ptr<uint32_t[]> table;
+                uint32_t    base = 1;
+        };
+
+        //! largest block compress_into() can produce from len bytes
+        constexpr size_t compress_bound(size_t len) noexcept
+        {
+            return len + len / 255 + 16;
+        }
+
+        //! output capacity for decompressing raw_size bytes at full speed
+        constexpr size_t decompress_bound(size_t raw_size) noexcept
+        {
+            return raw_size + DECOMPRESS_SLACK;
+        }
+
+        // Using a context kept per thread, 0 means failure or empty input
+        size_t compress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity);
+        size_t decompress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity);
+    }
+
+    namespace huffman
+    {
+        /*
+            Static Huffman coding of bytes, one code table per call:
+
+              raw size            4 bytes  little-endian
+              code lengths        128 bytes, 4 bits per byte value, low nibble first,
+                                  0 for values that do not occur
+              stream sizes        3 x 4 bytes, sizes of the first three bitstreams
+              bitstreams          STREAMS streams, codes packed least significant bit first
+
+            The data is split into STREAMS equal parts, the last one taking the remainder,
+            and each part is coded into its own bitstream so the decoder can work on all
+            of them at once.  Codes are canonical and at most MAX_CODE_LENGTH bits, so the
+            decoder resolves every code, and often the one after it too, with one table
+            lookup.
+        */
+        constexpr uint32_t MAX_CODE_LENGTH = 11;
+        constexpr uint32_t STREAMS = 4;
+        constexpr size_t   HEADER_SIZE = 4 + 128 + 4 * (STREAMS - 1);
+
+        size_t encode(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity);
+        size_t decode(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity);
+
+        //! raw size stored in encoded data, 0 if there is no complete header
+        size_t decoded_size(const uint8_t* src, size_t len) noexcept;
+    }
+
+    /**
+     * @brief Block compression algorithm
+     *
+     * Codecs compress and decompress whole blocks in caller-provided memory.  The
+     * compressed data has no header, the caller keeps the uncompressed size.  Both
+     * functions return the number of bytes written, 0 on failure.
+     *
+     * The concrete codecs are final, so code templated on the codec type calls them
+     * directly, while code holding a Codec reference picks the codec at runtime.
+     */
+    class Codec
+    {
+        public:
+            virtual ~Codec() = default;
+
+            //! short name identifying the codec and its stream format
+            virtual const char* name() const noexcept = 0;
+
+            //! compress output capacity that is always enough for len bytes of input
+            virtual size_t      bound(size_t len) const noexcept = 0;
+
+            virtual size_t      compress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) const = 0;
+            virtual size_t      decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) const = 0;
+    };
+
+    class LZFCodec final : public Codec
+    {
+        public:
+            constexpr LZFCodec(lzf::Level level = lzf::Level::fast) noexcept : level(level) {}
+
+            const char* name() const noexcept override;
+            size_t      bound(size_t len) const noexcept override;
+
+            size_t      compress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) const override;
+            size_t      decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) const override;
+
+        private:
+            lzf::Level  level;
+    };
+
+    class LZ4Codec final : public Codec
+    {
+        public:
+            const char* name() const noexcept override;
+            size_t      bound(size_t len) const noexcept override;
+
+            size_t      compress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) const override;
+            size_t      decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) const override;
+    };
+
+    //! codec by name: "lzf", "lzf-high" or "lz4", nullptr if there is no such codec
+    const Codec* find_codec(const std::string& name);
+
+    #ifdef NO_CONCEPTS
+    #define CompressionCodec typename
+    #else
+    template <typename T>
+    concept bool CompressionCodec = requires(const T& codec, const uint8_t* src, uint8_t* dst, size_t len)
+    {
+        { codec.name() } -> const char*;
+        { codec.bound(len) } -> size_t;
+        { codec.compress(src, len, dst, len) } -> size_t;
+        { codec.decompress(src, len, dst, len) } -> size_t;
+    };
+    #endif
+
+    template <CompressionCodec CodecType>
+    void compress(const CodecType& codec, const Buffer& input, Buffer& output);
+
+    template <CompressionCodec CodecType>
+    bool decompress(const CodecType& codec, const Buffer& input, Buffer& output, size_t raw_size);
+
+    // IMPLEMENTATIONS
+
+    /**
+     * @brief Compress a whole buffer with a codec
+     *
+     * @param codec     codec to use, a concrete codec type is called without virtual dispatch
+     * @param input     data to compress
+     * @param output    replaced by the compressed data, keeps its capacity
+     */
+    template <CompressionCodec CodecType>
+    inline void compress(const CodecType& codec, const Buffer& input, Buffer& output)
+    {
+        output.clear();
+        output.resize_uninitialized(codec.bound(input.size()));
+
+        size_t len = codec.compress(input.data(), input.size(), output.data(), output.size());
+        output.resize(len);
+    }
+
+    /**
+     * @brief Decompress a whole buffer with a codec
+     *
+     * @param codec     codec the data was compressed with
+     * @param input     compressed data
+     * @param output    replaced by the decompressed data
+     * @param raw_size  size of the data before compression
+     *
+     * @return false if the data is corrupt or does not decompress to raw_size bytes
+     */
+    template <CompressionCodec CodecType>
+    inline bool decompress(const CodecType& codec, const Buffer& input, Buffer& output, size_t raw_size)
+    {
+        output.clear();
+
+        if (raw_size == 0)
+            return true;
+
+        output.resize_uninitialized(raw_size + lzf::DECOMPRESS_SLACK);
+
+        size_t len = codec.decompress(input.data(), input.size(), output.data(), output.size());
+        output.resize(len == raw_size ? len : 0);
+
+        return len == raw_size;
     }
 }
 
@@ -27,27 +463,71 @@ namespace mush
 
 #ifdef MUSH_IMPLEMENT_COMPRESSION
 
-#define UPDATE_HASH(v,p) { v = *((uint16_t*)p); v ^= *((uint16_t*)(p+1))^(v>>(16-LZF_HASH_LOG)); }
-
 namespace mush
 {
     namespace detail
     {
+        // hash of the 3 bytes at p, the same values as the original FastLZ macro
+        template <uint32_t HashLog>
+        inline uint32_t lzf_hash(const uint8_t* p) noexcept
+        {
+            uint16_t a, b;
+            memcpy(&a, p, 2);
+            memcpy(&b, p + 1, 2);
+
+            uint32_t v = a;
+            v ^= b ^ (v >> (16 - HashLog));
+            return v & ((1u << HashLog) - 1);
+        }
+
+        // length of the common prefix of a and b up to limit bytes, compared 8 bytes at a time
+        inline size_t common_length(const uint8_t* a, const uint8_t* b, size_t limit) noexcept
+        {
+            size_t len = 0;
+
+            while (len + 8 <= limit)
+            {
+                uint64_t diff = load<uint64_t>(a + len, false) ^ load<uint64_t>(b + len, false);
+                if (diff != 0)
+                {
+                    #if defined(__GNUC__) || defined(__clang__)
+                    return len + (__builtin_ctzll(diff) >> 3);
+                    #else
+                    // the byte loop below finds which byte of the word differs
+                    break;
+                    #endif
+                }
+
+                len += 8;
+            }
+
+            while (len < limit && a[len] == b[len])
+                ++len;
+
+            return len;
+        }
+
         // Lossless compression using LZF algorithm, this is faster on modern CPU than
         // the original implementation in http://liblzf.plan9.de/
-        int compress(const void* input, int length, void* output, int maxout)
+        //
+        // htab has 1 << FAST_HASH_LOG entries of position + base, entries below base are
+        // left from earlier inputs and count as position 0
+        //
+        // the first start bytes of input are history that matches may refer to but that
+        // is not compressed, for preset dictionaries
+        int compress(const void* input, int length, void* output, int maxout, uint32_t* htab, uint32_t base,
+                     int start = 0)
         {
-            if (input == 0 || length < 1 || output == 0 || maxout < 2) {
+            if (input == 0 || length <= start || output == 0 || maxout < 2) {
                 return 0;
             }
 
-            const uint8_t* ip = (const uint8_t*) input;
-            const uint8_t* ip_limit = ip + length - mush::lzf::MAX_COPY - 4;
+            const uint8_t* in = (const uint8_t*) input;
+            const uint8_t* ip = in + start;
+            const uint8_t* ip_limit = in + length - mush::lzf::MAX_COPY - 4;
             uint8_t* op = (uint8_t*) output;
             const uint8_t* last_op = (uint8_t*) output + maxout - 1;
 
-            const uint8_t* htab[LZF_HASH_SIZE];
-            const uint8_t** hslot;
             uint32_t hval;
 
             uint8_t* ref;
@@ -56,11 +536,6 @@ namespace mush
             int32_t distance;
             uint8_t* anchor;
 
-            /* initializes hash table */
-            for (hslot = htab; hslot < htab + LZF_HASH_SIZE; ++hslot) {
-                *hslot = ip;
-            }
-
             /* we start with literal copy */
             copy = 0;
             *op++ = mush::lzf::MAX_COPY - 1;
@@ -68,23 +543,18 @@ namespace mush
             /* main loop */
             while (ip < ip_limit) {
                 /* find potential match */
-                UPDATE_HASH(hval, ip);
-                hslot = htab + (hval & LZF_HASH_MASK);
-                ref = (uint8_t*) * hslot;
+                hval = lzf_hash<lzf::FAST_HASH_LOG>(ip);
+                ref = (uint8_t*) in + (htab[hval] >= base ? htab[hval] - base : 0);
 
                 /* update hash table */
-                *hslot = ip;
+                htab[hval] = (ip - in) + base;
 
                 /* find itself? then it's no match */
                 if (ip == ref)
                     goto literal;
 
-                /* is this a match? check the first 2 bytes */
-                if (*((uint16_t*)ref) != *((uint16_t*)ip))
-                    goto literal;
-
-                /* now check the 3rd byte */
-                if (ref[2] != ip[2])
+                /* is this a match? check the first 3 bytes with one load */
+                if (((load<uint32_t>(ref, false) ^ load<uint32_t>(ip, false)) & 0xffffff) != 0)
                     goto literal;
 
                 /* calculate distance to the match */
@@ -97,28 +567,18 @@ namespace mush
                 /* here we have 3-byte matches */
                 anchor = (uint8_t*)ip;
                 len = 3;
-                ref += 3;
-                ip += 3;
-
-                /* now we have to check how long the match is */
-                if (ip < ip_limit - mush::lzf::MAX_LEN) {
-                    while (len < mush::lzf::MAX_LEN - 8) {
-                        /* unroll 8 times */
-                        if (*ref++ != *ip++) break;
-                        if (*ref++ != *ip++) break;
-                        if (*ref++ != *ip++) break;
-                        if (*ref++ != *ip++) break;
-                        if (*ref++ != *ip++) break;
-                        if (*ref++ != *ip++) break;
-                        if (*ref++ != *ip++) break;
-                        if (*ref++ != *ip++) break;
-                        len += 8;
-                    }
-                    --ip;
-                }
-                len = ip - anchor;
 
-                /* just before the last non-matching byte */
+                /* now we have to check how long the match is, up to 258 bytes.  Without
+                   history only while more than MAX_LEN bytes are left, as the encoder always
+                   has, so its output does not change.  Dictionary inputs are short, there
+                   matches extend up to ip_limit */
+                if (start > 0)
+                    len += common_length(ip + 3, ref + 3,
+                                         std::min<size_t>(mush::lzf::MAX_LEN - 9, std::max<ptrdiff_t>(ip_limit - ip - 3, 0)));
+                else if (ip_limit - ip > (ptrdiff_t)mush::lzf::MAX_LEN + 3)
+                    len += common_length(ip + 3, ref + 3, mush::lzf::MAX_LEN - 9);
+
+                /* continue after the match */
                 ip = anchor + len;
 
                 /* if we have copied something, adjust the copy count */
@@ -158,8 +618,8 @@ namespace mush
 
                 /* update the hash at match boundary */
                 --ip;
-                UPDATE_HASH(hval, ip);
-                htab[hval & LZF_HASH_MASK] = ip;
+                hval = lzf_hash<lzf::FAST_HASH_LOG>(ip);
+                htab[hval] = (ip - in) + base;
                 ++ip;
 
                 continue;
@@ -182,8 +642,9 @@ namespace mush
 
             // TODO: smart calculation to see here if enough output is left
 
+            // the main loop may leave op one past last_op, hence >= below
             while (ip < ip_limit) {
-                if (op == last_op) {
+                if (op >= last_op) {
                     return 0;
                 }
                 *op++ = *ip++;
@@ -192,7 +653,7 @@ namespace mush
                     // start next literal copy item
                     copy = 0;
                     if (ip < ip_limit) {
-                        if (op == last_op) {
+                        if (op >= last_op) {
                             return 0;
                         }
                         *op++ = mush::lzf::MAX_COPY - 1;
@@ -214,7 +675,221 @@ namespace mush
             return op - (uint8_t*)output;
         }
 
-        int decompress(const void* input, int length, void* output, int maxout)
+        // append a run of literals, split into items of at most MAX_COPY bytes
+        inline bool emit_literals(const uint8_t* src, int32_t count, uint8_t*& op, const uint8_t* op_end) noexcept
+        {
+            while (count > 0)
+            {
+                int32_t run = std::min<int32_t>(count, lzf::MAX_COPY);
+                if (op + 1 + run > op_end)
+                    return false;
+
+                *op++ = run - 1;
+                memcpy(op, src, run);
+                op += run;
+                src += run;
+                count -= run;
+            }
+            return true;
+        }
+
+        // append a back reference, len is at least 3 and distance at least 1
+        inline bool emit_match(int32_t len, int32_t distance, uint8_t*& op, const uint8_t* op_end) noexcept
+        {
+            len -= 2;
+            --distance;
+
+            if (len < 7)
+            {
+                if (op + 2 > op_end)
+                    return false;
+
+                *op++ = (len << 5) + (distance >> 8);
+            }
+            else
+            {
+                if (op + 3 > op_end)
+                    return false;
+
+                *op++ = (7 << 5) + (distance >> 8);
+                *op++ = len - 7;
+            }
+            *op++ = distance & 255;
+            return true;
+        }
+
+        // LZF compression with hash chains and lazy matching, same output format as compress()
+        //
+        // head has 1 << HIGH_HASH_LOG entries and chain MAX_DISTANCE entries of position + base,
+        // entries below base are left from earlier inputs and end the chain
+        //
+        // the first start bytes of input are history as with compress()
+        int compress_high(const void* input, int length, void* output, int maxout,
+                          uint32_t* head, uint32_t* chain, uint32_t base, int start = 0)
+        {
+            if (input == 0 || length <= start || output == 0 || maxout < 2) {
+                return 0;
+            }
+
+            constexpr int32_t window_mask = lzf::MAX_DISTANCE - 1;
+
+            const uint8_t* in = (const uint8_t*)input;
+            uint8_t* op = (uint8_t*)output;
+            const uint8_t* op_end = op + maxout;
+
+            // a match needs 3 bytes to hash
+            const int32_t match_limit = length - 2;
+
+            auto insert = [&](int32_t pos)
+            {
+                uint32_t h = lzf_hash<lzf::HIGH_HASH_LOG>(in + pos);
+                chain[pos & window_mask] = head[h];
+                head[h] = pos + base;
+            };
+
+            auto find = [&](int32_t pos, int32_t& distance)
+            {
+                int32_t best = 0;
+                int32_t max_len = std::min<int32_t>(lzf::MAX_LEN, length - pos);
+                uint32_t entry = head[lzf_hash<lzf::HIGH_HASH_LOG>(in + pos)];
+
+                for (uint32_t depth = 0; depth < lzf::HIGH_CHAIN_DEPTH; ++depth)
+                {
+                    if (entry < base || pos - (int32_t)(entry - base) >= (int32_t)lzf::MAX_DISTANCE)
+                        break;
+
+                    int32_t candidate = entry - base;
+
+                    // cannot beat the best so far unless the byte after it matches
+                    if (in[candidate + best] == in[pos + best])
+                    {
+                        int32_t len = common_length(in + candidate, in + pos, max_len);
+
+                        if (len > best)
+                        {
+                            best = len;
+                            distance = pos - candidate;
+
+                            if (best == max_len)
+                                break;
+                        }
+                    }
+
+                    entry = chain[candidate & window_mask];
+                }
+
+                return best >= 3 ? best : 0;
+            };
+
+            for (int32_t i = std::max(0, start - (int32_t)lzf::MAX_DISTANCE); i < start && i < match_limit; ++i)
+                insert(i);
+
+            int32_t pos = start;
+            int32_t literal_start = start;
+
+            while (pos < match_limit)
+            {
+                int32_t distance;
+                int32_t len = find(pos, distance);
+
+                if (len == 0)
+                {
+                    insert(pos++);
+                    continue;
+                }
+
+                insert(pos);
+
+                // take the match one byte later instead if it is longer
+                while (pos + 1 < match_limit)
+                {
+                    int32_t next_distance;
+                    int32_t next_len = find(pos + 1, next_distance);
+
+                    if (next_len <= len)
+                        break;
+
+                    insert(++pos);
+                    len = next_len;
+                    distance = next_distance;
+                }
+
+                if (!emit_literals(in + literal_start, pos - literal_start, op, op_end)
+                 || !emit_match(len, distance, op, op_end))
+                    return 0;
+
+                for (int32_t i = pos + 1; i < pos + len && i < match_limit; ++i)
+                    insert(i);
+
+                pos += len;
+                literal_start = pos;
+            }
+
+            if (!emit_literals(in + literal_start, length - literal_start, op, op_end))
+                return 0;
+
+            return op - (uint8_t*)output;
+        }
+
+        inline lzf::Context& thread_context()
+        {
+            thread_local lzf::Context context;
+            return context;
+        }
+
+        // copy len bytes in steps of Step bytes, may write up to Step - 1 bytes past dst + len,
+        // src has to be at least Step bytes behind dst when the ranges overlap
+        template <size_t Step>
+        inline void wild_copy(uint8_t* dst, const uint8_t* src, size_t len) noexcept
+        {
+            uint8_t* end = dst + len;
+            do
+            {
+                memcpy(dst, src, Step);
+                dst += Step;
+                src += Step;
+            }
+            while (dst < end);
+        }
+
+        // copy a back reference of len bytes from distance bytes back, room is how much
+        // the output has space for from op onwards and at least len
+        inline void copy_match(uint8_t* op, size_t distance, size_t len, size_t room) noexcept
+        {
+            const uint8_t* ref = op - distance;
+
+            if (distance >= 32 && room >= len + 16) {
+                wild_copy<16>(op, ref, len);
+            } else if (len < 8 || room < len + 8) {
+                /* short or close to just written bytes, wide loads from there would
+                   stall on store forwarding */
+                op[0] = ref[0];
+                op[1] = ref[1];
+                op[2] = ref[2];
+
+                for (size_t i = 3; i < len; ++i)
+                    op[i] = ref[i];
+            } else if (distance >= 8) {
+                wild_copy<8>(op, ref, len);
+            } else {
+                /* short repeating pattern, write the first 8 bytes one at a time and
+                   continue from a whole number of periods of at least 8 bytes back */
+                constexpr uint8_t period_span[8] = { 0, 8, 8, 9, 8, 10, 12, 14 };
+
+                for (size_t i = 0; i < 8; ++i)
+                    op[i] = ref[i];
+
+                wild_copy<8>(op + 8, op + 8 - period_span[distance], len - 8);
+            }
+        }
+
+        // Decoder that copies in whole 16 or 32 byte steps where the output has room for
+        // it, and exactly near the end of the input and of the output
+        //
+        // back references reaching before output continue into the last bytes of history,
+        // the preset dictionary the data was compressed with
+        int decompress(const void* input, int length, void* output, int maxout,
+                       const uint8_t* history = nullptr, size_t history_len = 0)
         {
             if (input == 0 || length < 1) {
                 return 0;
@@ -224,150 +899,1683 @@ namespace mush
             }
 
             const uint8_t* ip = (const uint8_t*) input;
-            const uint8_t* ip_limit  = ip + length - 1;
+            const uint8_t* ip_end = ip + length;
             uint8_t* op = (uint8_t*) output;
             uint8_t* op_limit = op + maxout;
-            uint8_t* ref;
 
-            while (ip < ip_limit) {
-                uint32_t ctrl = (*ip) + 1;
-                uint32_t ofs = ((*ip) & 31) << 8;
-                uint32_t len = (*ip++) >> 5;
+            while (ip < ip_end) {
+                uint32_t ctrl = *ip++;
 
-                if (ctrl < 33) {
-                    /* literal copy */
-                    if (op + ctrl > op_limit)
-                    {
+                if (ctrl < 32) {
+                    /* literal run of 1 to 32 bytes */
+                    size_t run = ctrl + 1;
+
+                    if ((size_t)(op_limit - op) < run || (size_t)(ip_end - ip) < run) {
                         return 0;
                     }
 
-                    /* crazy unrolling */
-                    if (ctrl) {
-                        *op++ = *ip++;
-                        --ctrl;
+                    if (op_limit - op >= 32 && ip_end - ip >= 32) {
+                        memcpy(op, ip, 16);
+                        memcpy(op + 16, ip + 16, 16);
+                    } else {
+                        memcpy(op, ip, run);
+                    }
 
-                        if (ctrl) {
-                            *op++ = *ip++;
-                            --ctrl;
+                    op += run;
+                    ip += run;
+                    continue;
+                }
 
-                            if (ctrl) {
-                                *op++ = *ip++;
-                                --ctrl;
+                /* back reference of 3 to 264 bytes */
+                size_t len = ctrl >> 5;
 
-                                for (;ctrl; --ctrl)
-                                    *op++ = *ip++;
-                            }
-                        }
-                    }
-                } else {
-                    /* back reference */
-                    --len;
-                    ref = op - ofs;
-                    --ref;
+                if (ip_end - ip < (len == 7 ? 2 : 1)) {
+                    return 0;
+                }
 
-                    if (len == 7 - 1)
-                        len += *ip++;
+                if (len == 7)
+                    len += *ip++;
+                len += 2;
 
-                    ref -= *ip++;
+                size_t distance = ((ctrl & 31) << 8) + *ip++ + 1;
 
-                    if (op + len + 3 > op_limit)
-                    {
-                        return 0;
-                    }
+                if ((size_t)(op_limit - op) < len) {
+                    return 0;
+                }
 
-                    if (ref < (uint8_t *)output)
-                    {
+                if (distance > (size_t)(op - (uint8_t*)output)) {
+                    size_t back = distance - (op - (uint8_t*)output);
+
+                    if (back > history_len) {
                         return 0;
                     }
 
-                    *op++ = *ref++;
-                    *op++ = *ref++;
-                    *op++ = *ref++;
-                    if (len)
-                        for (; len; --len)
-                            *op++ = *ref++;
+                    /* the part before output comes from the dictionary, the rest
+                       starts at the beginning of output and may be shorter than the
+                       3 bytes copy_match() writes, so it is copied one byte at a time */
+                    size_t head = std::min(len, back);
+                    memcpy(op, history + history_len - back, head);
+
+                    for (size_t i = head; i < len; ++i)
+                        op[i] = op[i - distance];
+
+                    op += len;
+                    continue;
                 }
+
+                copy_match(op, distance, len, op_limit - op);
+                op += len;
             }
 
             return op - (uint8_t*)output;
         }
     }
 
-    Buffer lzf::compress(const Buffer& input)
+    lzf::Context::Context()
+        : fast_table(new uint32_t[1 << FAST_HASH_LOG]())
     {
-        Buffer output;
+    }
 
-        if (input.size() == 0)
-            return output;
+    // base for an input of len bytes, clears the tables once the offsets would wrap
+    uint32_t lzf::Context::claim(size_t len)
+    {
+        if ((uint64_t)base + len >= UINT32_MAX)
+        {
+            std::fill(fast_table.get(), fast_table.get() + (1 << FAST_HASH_LOG), 0);
 
-        input.seek(0);
-        output.seek(0);
+            if (high_head)
+            {
+                std::fill(high_head.get(), high_head.get() + (1 << HIGH_HASH_LOG), 0);
+                std::fill(high_chain.get(), high_chain.get() + MAX_DISTANCE, 0);
+            }
 
-        const void* const in_data = (const void*)input.data();
-        uint32_t in_len = (uint32_t)input.size();
+            base = 1;
+        }
 
-        output.resize(in_len + 4 + 1);
+        uint32_t rval = base;
+        base += len;
+        return rval;
+    }
 
-        output[0] = in_len & 255;
-        output[1] = (in_len >> 8) & 255;
-        output[2] = (in_len >> 16) & 255;
-        output[3] = (in_len >> 24) & 255;
-        output[4] = 1;
+    /**
+     * @brief Compress into caller-provided memory
+     *
+     * Writes a raw LZF stream without any header, the caller has to keep the
+     * uncompressed size to decompress it again.
+     *
+     * @param src       input data
+     * @param len       length of the input
+     * @param dst       where to write the compressed data
+     * @param capacity  room in dst, compress_bound(len) is always enough
+     * @param level     compression level
+     *
+     * @return size of the compressed data, 0 if it did not fit into capacity
+     */
+    size_t lzf::Context::compress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity, Level level)
+    {
+        if (len == 0 || len > INT32_MAX)
+            return 0;
 
-        uint32_t out_len = in_len - 1;
-        uint8_t* out_data = (uint8_t*)(output.data() + 5);
+        int maxout = (int)std::min<size_t>(capacity, INT32_MAX);
+
+        if (level == Level::high)
+        {
+            if (!high_head)
+            {
+                high_head.reset(new uint32_t[1 << HIGH_HASH_LOG]());
+                high_chain.reset(new uint32_t[MAX_DISTANCE]());
+            }
 
-        uint32_t len = detail::compress(in_data, in_len, out_data, out_len);
+            return detail::compress_high(src, (int)len, dst, maxout, high_head.get(), high_chain.get(), claim(len));
+        }
 
-        if ((len > out_len) || (len == 0))
+        return detail::compress(src, (int)len, dst, maxout, fast_table.get(), claim(len));
+    }
+
+    /**
+     * @brief Decompress a raw LZF stream into caller-provided memory
+     *
+     * @return size of the decompressed data, 0 if the input is corrupt or the data
+     *         did not fit into capacity
+     */
+    size_t lzf::Context::decompress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity)
+    {
+        return lzf::decompress_into(src, len, dst, capacity);
+    }
+
+    size_t lzf::compress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity, Level level)
+    {
+        return detail::thread_context().compress_into(src, len, dst, capacity, level);
+    }
+
+    size_t lzf::decompress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity)
+    {
+        if (len > INT32_MAX)
+            return 0;
+
+        int rval = detail::decompress(src, (int)len, dst, (int)std::min<size_t>(capacity, INT32_MAX));
+        return rval < 0 ? 0 : rval;
+    }
+
+    namespace detail
+    {
+        inline uint64_t next_dictionary_id() noexcept
         {
-            output.replace(5, output.size() - 5, input);
-            output[4] = 0;
-        } else {
-            output.resize(len + 5);
+            static std::atomic<uint64_t> counter = 0;
+            return ++counter;
         }
+    }
 
-        output.shrink_to_fit();
+    lzf::Dictionary::Dictionary(const uint8_t* data, size_t len)
+        : fast_table(1 << FAST_HASH_LOG, 0), id(detail::next_dictionary_id())
+    {
+        if (len > MAX_DISTANCE)
+        {
+            data += len - MAX_DISTANCE;
+            len = MAX_DISTANCE;
+        }
 
-        return output;
+        content.resize_uninitialized(len);
+        if (len > 0)
+            memcpy(content.data(), data, len);
+
+        // the same entries compressing the dictionary itself would leave behind
+        for (size_t i = 0; i + 2 < len; ++i)
+            fast_table[detail::lzf_hash<FAST_HASH_LOG>(content.data() + i)] = i + 1;
     }
 
-    Buffer lzf::uncompress(const Buffer& input)
+    lzf::Dictionary::Dictionary(const Buffer& content)
+        : Dictionary(content.data(), content.size())
     {
-        Buffer output;
-/*
-        std::cout << input.size() / 4 << "\n";
+    }
 
-        for (size_t i = 0; i < input.size(); ++i)
-            printf("%02x\n", input[i]);
-*/
-        size_t unpacked_size = 0;
-        unpacked_size |= ((uint8_t)input[0]);
-        unpacked_size |= ((uint8_t)input[1]) << 8;
-        unpacked_size |= ((uint8_t)input[2]) << 16;
-        unpacked_size |= ((uint8_t)input[3]) << 24;
+    const uint8_t* lzf::Dictionary::data() const noexcept
+    {
+        return content.data();
+    }
 
-        input.seek(0);
-        size_t unpacked = input.read<uint32_t>();
+    size_t lzf::Dictionary::size() const noexcept
+    {
+        return content.size();
+    }
 
-        output.resize(unpacked_size);
+    /**
+     * @brief Compress into caller-provided memory using a preset dictionary
+     *
+     * The input is compressed as if it followed the dictionary, the same dictionary is
+     * needed to decompress it.  Parameters and return value are as without one.
+     */
+    size_t lzf::Context::compress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity,
+                                       const Dictionary& dictionary, Level level)
+    {
+        size_t start = dictionary.size();
+        if (start == 0)
+            return compress_into(src, len, dst, capacity, level);
 
-        uint8_t flag = input[4];
+        if (len == 0 || len > INT32_MAX - MAX_DISTANCE)
+            return 0;
 
-        const void* const in_data = (const void*)(input.data() + 5);
-        int in_len = (int)input.size() - 5;
-        uint8_t* out_data = output.data();
-        uint32_t out_len = unpacked_size;
+        if (window_id != dictionary.id)
+        {
+            window.resize_uninitialized(start);
+            memcpy(window.data(), dictionary.data(), start);
+            window_id = dictionary.id;
+        }
 
-        if (flag == 0) {
-            memcpy(output.data(), in_data, in_len);
-        } else {
-            size_t len = detail::decompress(in_data, in_len, out_data, out_len);
-            assert(len != 0);
-            assert(unpacked == out_len);
+        window.resize_uninitialized(start + len);
+        memcpy(window.data() + start, src, len);
+
+        int maxout = (int)std::min<size_t>(capacity, INT32_MAX);
+
+        if (level == Level::high)
+        {
+            if (!high_head)
+            {
+                high_head.reset(new uint32_t[1 << HIGH_HASH_LOG]());
+                high_chain.reset(new uint32_t[MAX_DISTANCE]());
+            }
+
+            // the dictionary positions are inserted again, the chains are too large to copy
+            return detail::compress_high(window.data(), (int)(start + len), dst, maxout,
+                                         high_head.get(), high_chain.get(), claim(start + len), (int)start);
         }
 
-        return output;
+        if (!dictionary_table)
+            dictionary_table.reset(new uint32_t[1 << FAST_HASH_LOG]);
+
+        memcpy(dictionary_table.get(), dictionary.fast_table.data(), sizeof(uint32_t) << FAST_HASH_LOG);
+
+        return detail::compress(window.data(), (int)(start + len), dst, maxout, dictionary_table.get(), 1, (int)start);
+    }
+
+    size_t lzf::Context::decompress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity,
+                                         const Dictionary& dictionary)
+    {
+        return lzf::decompress_into(src, len, dst, capacity, dictionary);
+    }
+
+    size_t lzf::compress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity,
+                              const Dictionary& dictionary, Level level)
+    {
+        return detail::thread_context().compress_into(src, len, dst, capacity, dictionary, level);
+    }
+
+    /**
+     * @brief Decompress a raw LZF stream that was compressed with a preset dictionary
+     *
+     * @return size of the decompressed data, 0 if the input is corrupt, was compressed
+     *         with a different dictionary or the data did not fit into capacity
+     */
+    size_t lzf::decompress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity,
+                                const Dictionary& dictionary)
+    {
+        if (len > INT32_MAX)
+            return 0;
+
+        int rval = detail::decompress(src, (int)len, dst, (int)std::min<size_t>(capacity, INT32_MAX),
+                                      dictionary.data(), dictionary.size());
+        return rval < 0 ? 0 : rval;
+    }
+
+    Buffer lzf::compress(const Buffer& input, Level level)
+    {
+        Buffer output;
+        compress(input, output, level);
+        output.shrink_to_fit();
+
+        return output;
+    }
+
+    void lzf::compress(const Buffer& input, Buffer& output, Level level)
+    {
+        output.clear();
+
+        if (input.size() == 0)
+            return;
+
+        input.seek(0);
+        output.seek(0);
+
+        const void* const in_data = (const void*)input.data();
+        uint32_t in_len = (uint32_t)input.size();
+
+        output.resize_uninitialized(in_len + 4 + 1);
+
+        output[0] = in_len & 255;
+        output[1] = (in_len >> 8) & 255;
+        output[2] = (in_len >> 16) & 255;
+        output[3] = (in_len >> 24) & 255;
+        output[4] = 1;
+
+        uint32_t out_len = in_len - 1;
+        uint8_t* out_data = (uint8_t*)(output.data() + 5);
+
+        uint32_t len = detail::thread_context().compress_into((const uint8_t*)in_data, in_len, out_data, out_len, level);
+
+        if ((len > out_len) || (len == 0))
+        {
+            output.replace(5, output.size() - 5, input);
+            output[4] = 0;
+        } else {
+            output.resize(len + 5);
+        }
+    }
+
+    Buffer lzf::uncompress(const Buffer& input)
+    {
+        Buffer output;
+        uncompress(input, output);
+
+        return output;
+    }
+
+    bool lzf::uncompress(const Buffer& input, Buffer& output)
+    {
+/*
+        std::cout << input.size() / 4 << "\n";
+
+        for (size_t i = 0; i < input.size(); ++i)
+            printf("%02x\n", input[i]);
+*/
+        // compress() gives an empty buffer for empty input
+        if (input.size() < 5)
+        {
+            output.clear();
+            return input.size() == 0;
+        }
+
+        size_t unpacked_size = 0;
+        unpacked_size |= ((uint8_t)input[0]);
+        unpacked_size |= ((uint8_t)input[1]) << 8;
+        unpacked_size |= ((uint8_t)input[2]) << 16;
+        unpacked_size |= ((uint8_t)input[3]) << 24;
+
+        const uint8_t* in_data = input.data() + 5;
+        size_t in_len = input.size() - 5;
+
+        if (input[4] == 0 && in_len == unpacked_size)
+        {
+            output.resize_uninitialized(in_len);
+            memcpy(output.data(), in_data, in_len);
+            return true;
+        }
+
+        // Checked before allocating so a lying header cannot ask for gigabytes
+        if (input[4] != 1 || unpacked_size > in_len * MAX_EXPANSION)
+        {
+            output.clear();
+            return false;
+        }
+
+        output.resize_uninitialized(decompress_bound(unpacked_size));
+
+        if (decompress_into(in_data, in_len, output.data(), output.size()) != unpacked_size)
+        {
+            output.clear();
+            return false;
+        }
+
+        output.resize(unpacked_size);
+        return true;
+    }
+
+    Buffer lzf::compress(const Buffer& input, const Dictionary& dictionary, Level level)
+    {
+        Buffer output;
+
+        if (input.size() == 0)
+            return output;
+
+        uint32_t in_len = (uint32_t)input.size();
+        output.resize_uninitialized(in_len + 4 + 1);
+        detail::store<uint32_t>(output.data(), in_len, false);
+
+        size_t len = detail::thread_context().compress_into(input.data(), in_len, output.data() + 5, in_len - 1,
+                                                            dictionary, level);
+        if (len == 0)
+        {
+            memcpy(output.data() + 5, input.data(), in_len);
+            output[4] = 0;
+        } else {
+            output[4] = 1;
+            output.resize(len + 5);
+        }
+
+        return output;
+    }
+
+    Result<Buffer> lzf::uncompress(const Buffer& input, const Dictionary& dictionary)
+    {
+        Buffer output;
+
+        // compress() gives an empty buffer for empty input
+        if (input.size() == 0)
+            return output;
+
+        if (input.size() < 5)
+            return Error("corrupt data");
+
+        size_t unpacked_size = detail::load<uint32_t>(input.data(), false);
+        const uint8_t* in_data = input.data() + 5;
+        size_t in_len = input.size() - 5;
+
+        // checked before allocating, like uncompress() without a dictionary
+        bool stored = input[4] == 0 && in_len == unpacked_size;
+        bool packed = input[4] == 1 && unpacked_size <= in_len * MAX_EXPANSION;
+
+        if (!stored && !packed)
+            return Error("corrupt data");
+
+        if (stored)
+        {
+            output.resize_uninitialized(in_len);
+            memcpy(output.data(), in_data, in_len);
+            return output;
+        }
+
+        output.resize_uninitialized(decompress_bound(unpacked_size));
+
+        if (decompress_into(in_data, in_len, output.data(), output.size(), dictionary) != unpacked_size)
+            return Error("corrupt data");
+
+        output.resize(unpacked_size);
+        return output;
+    }
+
+    namespace detail
+    {
+        constexpr uint32_t TRAIN_GRAM = 6;
+        constexpr uint32_t TRAIN_HASH_LOG = 20;
+        constexpr size_t   TRAIN_SEGMENT = 64;
+
+        inline uint32_t train_hash(const uint8_t* p) noexcept
+        {
+            uint64_t v = load<uint64_t>(p, false) << (64 - 8 * TRAIN_GRAM);
+            return (uint32_t)((v * 0x9e3779b97f4a7c15ull) >> (64 - TRAIN_HASH_LOG));
+        }
+    }
+
+    /**
+     * @brief Build a dictionary from sample inputs
+     *
+     * Counts in how many samples each short string occurs, then splits the samples into
+     * one stretch per dictionary segment and takes the segment from each stretch that
+     * covers the most common strings not already in the dictionary.  The best segments
+     * go last, nearest to the data.  Samples should look like the inputs the dictionary
+     * is meant for, a few hundred of them is usually plenty.
+     *
+     * @param samples   example inputs
+     * @param size      dictionary size, at most MAX_DISTANCE
+     */
+    lzf::Dictionary lzf::train_dictionary(const std::vector<Buffer>& samples, size_t size)
+    {
+        using detail::TRAIN_GRAM;
+        using detail::TRAIN_SEGMENT;
+
+        size = std::min<size_t>(size, MAX_DISTANCE);
+
+        Buffer joined;
+        for (const Buffer& sample : samples)
+            joined.insert(joined.end(), sample.begin(), sample.end());
+
+        if (joined.size() <= size || joined.size() < TRAIN_SEGMENT + 8)
+            return Dictionary(joined.data() + joined.size() - std::min(size, joined.size()), std::min(size, joined.size()));
+
+        // hashes of every string, read 8 bytes at a time so stop early enough
+        size_t positions = joined.size() - 8 + 1;
+        std::vector<uint32_t> hashes(positions);
+        for (size_t i = 0; i < positions; ++i)
+            hashes[i] = detail::train_hash(joined.data() + i);
+
+        // number of samples each string occurs in, strings across samples do not count
+        std::vector<uint32_t> counts(1 << detail::TRAIN_HASH_LOG, 0);
+        std::vector<uint32_t> last_seen(1 << detail::TRAIN_HASH_LOG, UINT32_MAX);
+
+        size_t offset = 0;
+        for (uint32_t index = 0; index < samples.size(); ++index)
+        {
+            size_t end = offset + samples[index].size();
+
+            for (size_t i = offset; i + TRAIN_GRAM <= end && i < positions; ++i)
+                if (last_seen[hashes[i]] != index)
+                {
+                    last_seen[hashes[i]] = index;
+                    ++counts[hashes[i]];
+                }
+
+            offset = end;
+        }
+
+        struct Segment
+        {
+            size_t      begin;
+            uint64_t    score;
+        };
+
+        std::vector<Segment> picked;
+        size_t stretches = std::max<size_t>(size / TRAIN_SEGMENT, 1);
+        size_t stretch = joined.size() / stretches;
+
+        // a segment scores the strings starting in it
+        constexpr size_t scored = TRAIN_SEGMENT - TRAIN_GRAM + 1;
+        size_t last_begin = positions - scored;
+
+        for (size_t n = 0; n < stretches; ++n)
+        {
+            size_t first = n * stretch;
+            size_t last = std::min(n + 1 == stretches ? last_begin : first + stretch, last_begin);
+            if (first > last)
+                break;
+
+            uint64_t score = 0;
+            for (size_t i = first; i < first + scored; ++i)
+                score += counts[hashes[i]];
+
+            Segment best = { first, score };
+
+            for (size_t begin = first + 1; begin <= last; ++begin)
+            {
+                score += counts[hashes[begin + scored - 1]];
+                score -= counts[hashes[begin - 1]];
+
+                if (score > best.score)
+                    best = Segment{ begin, score };
+            }
+
+            // only useful if some string in it occurs in more than one sample
+            if (best.score <= scored)
+                continue;
+
+            picked.push_back(best);
+
+            for (size_t i = best.begin; i < best.begin + scored; ++i)
+                counts[hashes[i]] = 0;
+        }
+
+        std::stable_sort(picked.begin(), picked.end(),
+                         [](const Segment& a, const Segment& b) { return a.score < b.score; });
+
+        Buffer content;
+        for (const Segment& segment : picked)
+            content.insert(content.end(), joined.begin() + segment.begin, joined.begin() + segment.begin + TRAIN_SEGMENT);
+
+        size_t len = std::min(size, content.size());
+        return Dictionary(content.data() + content.size() - len, len);
+    }
+
+    // Huffman coding
+
+    namespace detail
+    {
+        // decoding table entry, resolves one code or two consecutive short ones
+        struct HuffmanEntry
+        {
+            uint8_t symbols[2];
+            uint8_t bits;           // length of all resolved codes
+            uint8_t count;          // 0 for an invalid code
+        };
+
+        constexpr uint32_t HUFFMAN_TABLE_SIZE = 1 << huffman::MAX_CODE_LENGTH;
+
+        // code lengths from symbol counts, limited to MAX_CODE_LENGTH bits
+        inline void huffman_lengths(const uint32_t* counts, uint8_t* lengths)
+        {
+            constexpr uint32_t max_length = huffman::MAX_CODE_LENGTH;
+
+            uint16_t symbols[256];
+            uint32_t n = 0;
+
+            memset(lengths, 0, 256);
+            for (uint32_t i = 0; i < 256; ++i)
+                if (counts[i] != 0)
+                    symbols[n++] = i;
+
+            if (n == 0)
+                return;
+
+            if (n == 1)
+            {
+                lengths[symbols[0]] = 1;
+                return;
+            }
+
+            std::sort(symbols, symbols + n, [&](uint16_t a, uint16_t b) { return counts[a] < counts[b]; });
+
+            // two queue Huffman construction, leaves sorted by count and internal nodes
+            // created in non-decreasing weight order
+            uint64_t weight[512];
+            uint16_t parent[512];
+
+            for (uint32_t i = 0; i < n; ++i)
+                weight[i] = counts[symbols[i]];
+
+            uint32_t leaf = 0;
+            uint32_t node = n;
+
+            auto take = [&](uint32_t end)
+            {
+                if (leaf < n && (node >= end || weight[leaf] <= weight[node]))
+                    return leaf++;
+                return node++;
+            };
+
+            for (uint32_t next = n; next < 2 * n - 1; ++next)
+            {
+                uint32_t a = take(next);
+                uint32_t b = take(next);
+
+                weight[next] = weight[a] + weight[b];
+                parent[a] = next;
+                parent[b] = next;
+            }
+
+            uint8_t depth[512];
+            depth[2 * n - 2] = 0;
+            for (int32_t i = 2 * n - 3; i >= 0; --i)
+                depth[i] = depth[parent[i]] + 1;
+
+            // clamp long codes and lengthen the rarest shorter codes until the lengths
+            // are a valid prefix code again, kraft counts in units of 2^-max_length
+            uint32_t kraft = 0;
+            for (uint32_t i = 0; i < n; ++i)
+            {
+                depth[i] = std::min<uint32_t>(depth[i], max_length);
+                kraft += 1 << (max_length - depth[i]);
+            }
+
+            while (kraft > (1u << max_length))
+            {
+                uint32_t pick = n;
+                for (uint32_t i = 0; i < n; ++i)
+                    if (depth[i] < max_length && (pick == n || depth[i] > depth[pick]))
+                        pick = i;
+
+                kraft -= 1 << (max_length - depth[pick] - 1);
+                ++depth[pick];
+            }
+
+            // spend what is left on shortening the most common codes
+            for (int32_t i = n - 1; i >= 0; --i)
+                while (depth[i] > 1 && kraft + (1u << (max_length - depth[i])) <= (1u << max_length))
+                {
+                    kraft += 1 << (max_length - depth[i]);
+                    --depth[i];
+                }
+
+            for (uint32_t i = 0; i < n; ++i)
+                lengths[symbols[i]] = depth[i];
+        }
+
+        // canonical codes for the lengths, bit-reversed for least significant bit first output
+        inline void huffman_codes(const uint8_t* lengths, uint16_t* codes)
+        {
+            uint32_t length_count[huffman::MAX_CODE_LENGTH + 1] = {};
+            for (uint32_t i = 0; i < 256; ++i)
+                ++length_count[lengths[i]];
+            length_count[0] = 0;
+
+            uint32_t next_code[huffman::MAX_CODE_LENGTH + 1] = {};
+            uint32_t code = 0;
+            for (uint32_t bits = 1; bits <= huffman::MAX_CODE_LENGTH; ++bits)
+            {
+                code = (code + length_count[bits - 1]) << 1;
+                next_code[bits] = code;
+            }
+
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t bits = lengths[i];
+                if (bits == 0)
+                    continue;
+
+                uint32_t value = next_code[bits]++;
+                uint32_t reversed = 0;
+                for (uint32_t b = 0; b < bits; ++b)
+                    reversed |= ((value >> b) & 1) << (bits - 1 - b);
+
+                codes[i] = reversed;
+            }
+        }
+
+        // false if the lengths do not form a prefix code
+        inline bool huffman_table(const uint8_t* lengths, HuffmanEntry* table)
+        {
+            constexpr uint32_t max_length = huffman::MAX_CODE_LENGTH;
+
+            uint32_t kraft = 0;
+            for (uint32_t i = 0; i < 256; ++i)
+                if (lengths[i] != 0)
+                    kraft += 1 << (max_length - lengths[i]);
+
+            if (kraft == 0 || kraft > (1u << max_length))
+                return false;
+
+            uint16_t codes[256];
+            huffman_codes(lengths, codes);
+
+            memset(table, 0, sizeof(HuffmanEntry) * HUFFMAN_TABLE_SIZE);
+
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t bits = lengths[i];
+                if (bits == 0)
+                    continue;
+
+                for (uint32_t index = codes[i]; index < HUFFMAN_TABLE_SIZE; index += 1 << bits)
+                    table[index] = HuffmanEntry{ { (uint8_t)i, 0 }, (uint8_t)bits, 1 };
+            }
+
+            // pair each code with the one after it when both fit into the lookup bits
+            for (uint32_t index = 0; index < HUFFMAN_TABLE_SIZE; ++index)
+            {
+                HuffmanEntry& entry = table[index];
+                if (entry.count == 0)
+                    continue;
+
+                const HuffmanEntry& next = table[index >> entry.bits];
+                uint32_t next_bits = lengths[next.symbols[0]];
+                if (next.count == 0 || entry.bits + next_bits > max_length)
+                    continue;
+
+                entry.symbols[1] = next.symbols[0];
+                entry.bits += next_bits;
+                entry.count = 2;
+            }
+
+            return true;
+        }
+    }
+
+    /**
+     * @brief Huffman code a buffer
+     *
+     * @param src       data to code
+     * @param len       length of the data
+     * @param dst       where to write the coded data
+     * @param capacity  room in dst
+     *
+     * @return size of the coded data, 0 if it did not fit into capacity
+     */
+    size_t huffman::encode(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity)
+    {
+        if (len == 0 || len > UINT32_MAX || capacity < HEADER_SIZE)
+            return 0;
+
+        uint32_t counts[256] = {};
+        for (size_t i = 0; i < len; ++i)
+            ++counts[src[i]];
+
+        uint8_t lengths[256];
+        detail::huffman_lengths(counts, lengths);
+
+        uint64_t total_bits = 0;
+        for (uint32_t i = 0; i < 256; ++i)
+            total_bits += (uint64_t)counts[i] * lengths[i];
+
+        // each stream rounds up to whole bytes
+        if (HEADER_SIZE + total_bits / 8 + STREAMS > capacity)
+            return 0;
+
+        uint16_t codes[256];
+        detail::huffman_codes(lengths, codes);
+
+        detail::store<uint32_t>(dst, (uint32_t)len, false);
+        for (uint32_t i = 0; i < 128; ++i)
+            dst[4 + i] = lengths[2 * i] | (lengths[2 * i + 1] << 4);
+
+        size_t segment = len / STREAMS;
+        uint8_t* op = dst + HEADER_SIZE;
+
+        for (uint32_t stream = 0; stream < STREAMS; ++stream)
+        {
+            const uint8_t* ip = src + stream * segment;
+            const uint8_t* ip_end = stream == STREAMS - 1 ? src + len : ip + segment;
+            uint8_t* stream_start = op;
+
+            uint64_t bit_buffer = 0;
+            uint32_t bit_count = 0;
+
+            for (; ip < ip_end; ++ip)
+            {
+                bit_buffer |= (uint64_t)codes[*ip] << bit_count;
+                bit_count += lengths[*ip];
+
+                if (bit_count >= 32)
+                {
+                    detail::store<uint32_t>(op, (uint32_t)bit_buffer, false);
+                    op += 4;
+                    bit_buffer >>= 32;
+                    bit_count -= 32;
+                }
+            }
+
+            while (bit_count > 0)
+            {
+                *op++ = (uint8_t)bit_buffer;
+                bit_buffer >>= 8;
+                bit_count = bit_count > 8 ? bit_count - 8 : 0;
+            }
+
+            if (stream < STREAMS - 1)
+                detail::store<uint32_t>(dst + 4 + 128 + 4 * stream, (uint32_t)(op - stream_start), false);
+        }
+
+        return op - dst;
+    }
+
+    size_t huffman::decoded_size(const uint8_t* src, size_t len) noexcept
+    {
+        return len < HEADER_SIZE ? 0 : detail::load<uint32_t>(src, false);
+    }
+
+    namespace detail
+    {
+        struct HuffmanStream
+        {
+            const uint8_t*  ip;
+            const uint8_t*  ip_end;
+            uint8_t*        op;
+            uint8_t*        op_end;
+
+            uint64_t        bit_buffer = 0;
+            uint32_t        bit_count = 0;
+
+            // one symbol at a time near the end of the input or the output
+            bool decode_tail(const HuffmanEntry* table, const uint8_t* lengths) noexcept
+            {
+                while (op < op_end)
+                {
+                    while (bit_count <= 56 && ip < ip_end)
+                    {
+                        bit_buffer |= (uint64_t)*ip++ << bit_count;
+                        bit_count += 8;
+                    }
+
+                    const HuffmanEntry& entry = table[bit_buffer & (HUFFMAN_TABLE_SIZE - 1)];
+                    uint32_t bits = lengths[entry.symbols[0]];
+                    if (entry.count == 0 || bits > bit_count)
+                        return false;
+
+                    *op++ = entry.symbols[0];
+
+                    bit_buffer >>= bits;
+                    bit_count -= bits;
+                }
+
+                return true;
+            }
+        };
+    }
+
+    /**
+     * @brief Decode Huffman coded data
+     *
+     * @return size of the decoded data, 0 if the data is corrupt or did not fit into
+     *         capacity
+     */
+    size_t huffman::decode(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity)
+    {
+        size_t out_len = decoded_size(src, len);
+        if (out_len == 0 || out_len > capacity)
+            return 0;
+
+        // checked once after the loop, an exit inside it makes the compiler treat the
+        // rest of the function as cold
+        uint8_t lengths[256];
+        uint8_t longest = 0;
+        for (uint32_t i = 0; i < 128; ++i)
+        {
+            lengths[2 * i] = src[4 + i] & 15;
+            lengths[2 * i + 1] = src[4 + i] >> 4;
+            longest = std::max(longest, std::max(lengths[2 * i], lengths[2 * i + 1]));
+        }
+
+        if (longest > MAX_CODE_LENGTH)
+            return 0;
+
+        detail::HuffmanEntry table[detail::HUFFMAN_TABLE_SIZE];
+        if (!detail::huffman_table(lengths, table))
+            return 0;
+
+        size_t segment = out_len / STREAMS;
+        const uint8_t* ip = src + HEADER_SIZE;
+
+        detail::HuffmanStream streams[STREAMS];
+        for (uint32_t i = 0; i < STREAMS; ++i)
+        {
+            size_t size = i < STREAMS - 1 ? detail::load<uint32_t>(src + 4 + 128 + 4 * i, false)
+                                          : (size_t)(src + len - ip);
+            if (size > (size_t)(src + len - ip))
+                return 0;
+
+            streams[i].ip = ip;
+            streams[i].ip_end = ip + size;
+            streams[i].op = dst + i * segment;
+            streams[i].op_end = i < STREAMS - 1 ? dst + (i + 1) * segment : dst + out_len;
+
+            ip += size;
+        }
+
+        // the streams are independent, interleaving them keeps several lookups in flight,
+        // the state is copied to separate locals so it stays in registers even though the
+        // output is written through byte pointers
+        detail::HuffmanStream s0 = streams[0], s1 = streams[1], s2 = streams[2], s3 = streams[3];
+
+        auto fast_room = [](const detail::HuffmanStream& s)
+        {
+            return s.op_end - s.op >= 10 && s.ip_end - s.ip >= 8;
+        };
+
+        auto refill = [](detail::HuffmanStream& s)
+        {
+            s.bit_buffer |= detail::load<uint64_t>(s.ip, false) << s.bit_count;
+            s.ip += (63 - s.bit_count) >> 3;
+            s.bit_count |= 56;
+        };
+
+        // up to two symbols, invalid codes consume nothing and leave count at zero
+        auto lookup = [&table](detail::HuffmanStream& s)
+        {
+            const detail::HuffmanEntry& entry = table[s.bit_buffer & (detail::HUFFMAN_TABLE_SIZE - 1)];
+
+            s.op[0] = entry.symbols[0];
+            s.op[1] = entry.symbols[1];
+            s.op += entry.count;
+
+            s.bit_buffer >>= entry.bits;
+            s.bit_count -= entry.bits;
+
+            return (uint32_t)entry.count;
+        };
+
+        while (fast_room(s0) && fast_room(s1) && fast_room(s2) && fast_room(s3))
+        {
+            refill(s0);
+            refill(s1);
+            refill(s2);
+            refill(s3);
+
+            // five lookups use at most 55 of the 56 or more bits available
+            uint32_t valid = 1;
+            for (int round = 0; round < 5; ++round)
+            {
+                uint32_t n0 = lookup(s0);
+                uint32_t n1 = lookup(s1);
+                uint32_t n2 = lookup(s2);
+                uint32_t n3 = lookup(s3);
+
+                valid &= (n0 != 0) & (n1 != 0) & (n2 != 0) & (n3 != 0);
+            }
+
+            if (!valid)
+                return 0;
+        }
+
+        streams[0] = s0;
+        streams[1] = s1;
+        streams[2] = s2;
+        streams[3] = s3;
+
+        for (detail::HuffmanStream& stream : streams)
+            if (!stream.decode_tail(table, lengths))
+                return 0;
+
+        return out_len;
+    }
+
+    // Framed format
+
+    lzf::Compressor::Compressor(size_t block_size, Level level, Entropy entropy)
+        : block_size(block_size == 0 ? 1 : std::min(block_size, MAX_BLOCK_SIZE)), level(level), entropy(entropy)
+    {
+    }
+
+    namespace detail
+    {
+        // append a block header and the block data, stored as is if it does not shrink
+        inline void write_block(const uint8_t* data, size_t len, Buffer& output, lzf::Context& context,
+                                lzf::Level level, lzf::Entropy entropy)
+        {
+            size_t header = output.size();
+            uint8_t* dst = output.append_uninitialized(lzf::BLOCK_HEADER_SIZE + len) + lzf::BLOCK_HEADER_SIZE;
+
+            int packed = (int)context.compress_into(data, len, dst, len - 1, level);
+
+            uint8_t type = lzf::BLOCK_LZF;
+            if (packed <= 0 || (size_t)packed >= len)
+            {
+                memcpy(dst, data, len);
+                packed = (int)len;
+                type = lzf::BLOCK_STORED;
+            }
+
+            if (type == lzf::BLOCK_LZF && entropy == lzf::Entropy::huffman)
+            {
+                // code after the LZF data and keep the result if it is smaller
+                size_t lzf_end = header + lzf::BLOCK_HEADER_SIZE + packed;
+                output.resize(lzf_end);
+
+                uint8_t* coded = output.append_uninitialized(packed);
+                size_t coded_size = huffman::encode(coded - packed, packed, coded, packed - 1);
+
+                if (coded_size != 0)
+                {
+                    memmove(coded - packed, coded, coded_size);
+                    packed = (int)coded_size;
+                    type = lzf::BLOCK_LZF_HUFFMAN;
+                }
+            }
+
+            output.resize(header + lzf::BLOCK_HEADER_SIZE + packed);
+
+            uint8_t* hdr = output.data() + header;
+            hdr[0] = type;
+            store<uint32_t>(hdr + 1, (uint32_t)len, false);
+            store<uint32_t>(hdr + 5, (uint32_t)packed, false);
+        }
+
+        // block header fields, checked against the format limits
+        struct BlockHeader
+        {
+            uint8_t     type;
+            uint32_t    raw_size;
+            uint32_t    stored_size;
+        };
+
+        inline bool parse_block_header(const uint8_t* src, BlockHeader& header) noexcept
+        {
+            header.type = src[0];
+            header.raw_size = load<uint32_t>(src + 1, false);
+            header.stored_size = load<uint32_t>(src + 5, false);
+
+            if (header.type != lzf::BLOCK_STORED && header.type != lzf::BLOCK_LZF && header.type != lzf::BLOCK_LZF_HUFFMAN)
+                return false;
+
+            if (header.raw_size == 0 || header.raw_size > lzf::MAX_BLOCK_SIZE || header.stored_size > header.raw_size)
+                return false;
+
+            // sizes the stored data cannot decode to, Huffman codes are at least 1 bit
+            size_t max_raw = (size_t)header.stored_size * lzf::MAX_EXPANSION;
+            if (header.type == lzf::BLOCK_LZF_HUFFMAN)
+                max_raw *= 8;
+
+            if (header.raw_size > max_raw)
+                return false;
+
+            return header.type != lzf::BLOCK_STORED || header.stored_size == header.raw_size;
+        }
+
+        // decode block data into dst, which has room for capacity bytes, at least raw_size
+        inline bool read_block(const BlockHeader& header, const uint8_t* src, uint8_t* dst, size_t capacity)
+        {
+            if (header.type == lzf::BLOCK_STORED)
+            {
+                memcpy(dst, src, header.stored_size);
+                return true;
+            }
+
+            if (header.type == lzf::BLOCK_LZF_HUFFMAN)
+            {
+                // the LZF data is never larger than the block
+                size_t lzf_size = huffman::decoded_size(src, header.stored_size);
+                if (lzf_size == 0 || lzf_size > header.raw_size)
+                    return false;
+
+                thread_local Buffer scratch;
+                scratch.resize_uninitialized(lzf_size);
+
+                if (huffman::decode(src, header.stored_size, scratch.data(), lzf_size) != lzf_size)
+                    return false;
+
+                return decompress(scratch.data(), (int)lzf_size, dst, (int)capacity) == (int)header.raw_size;
+            }
+
+            return decompress(src, (int)header.stored_size, dst, (int)capacity) == (int)header.raw_size;
+        }
+
+        inline void write_frame_header(Buffer& output)
+        {
+            output.insert(output.end(), std::begin(lzf::FRAME_MAGIC), std::end(lzf::FRAME_MAGIC));
+            output.push_back(lzf::FRAME_VERSION);
+        }
+
+        inline void write_end_marker(Buffer& output, uint64_t total)
+        {
+            output.push_back(lzf::BLOCK_END);
+            store<uint64_t>(output.append_uninitialized(8), total, false);
+        }
+
+        inline bool check_frame_header(const uint8_t* src) noexcept
+        {
+            return memcmp(src, lzf::FRAME_MAGIC, sizeof(lzf::FRAME_MAGIC)) == 0 && src[4] == lzf::FRAME_VERSION;
+        }
+    }
+
+    void lzf::Compressor::emit_block(const uint8_t* data, size_t len, Buffer& output)
+    {
+        if (!started)
+        {
+            detail::write_frame_header(output);
+            started = true;
+        }
+
+        if (len != 0)
+            detail::write_block(data, len, output, context, level, entropy);
+    }
+
+    /**
+     * @brief Add input to the stream
+     *
+     * @param data      input data
+     * @param len       length of the input
+     * @param output    complete blocks are appended here
+     */
+    void lzf::Compressor::write(const uint8_t* data, size_t len, Buffer& output)
+    {
+        total += len;
+
+        // fill up a partially collected block first
+        if (!pending.empty())
+        {
+            size_t take = std::min(len, block_size - pending.size());
+            pending.insert(pending.end(), data, data + take);
+            data += take;
+            len -= take;
+
+            if (pending.size() < block_size)
+                return;
+
+            emit_block(pending.data(), pending.size(), output);
+            pending.clear();
+        }
+
+        // full blocks straight from the input without copying
+        while (len >= block_size)
+        {
+            emit_block(data, block_size, output);
+            data += block_size;
+            len -= block_size;
+        }
+
+        pending.insert(pending.end(), data, data + len);
+    }
+
+    void lzf::Compressor::write(const Buffer& input, Buffer& output)
+    {
+        write(input.data(), input.size(), output);
+    }
+
+    //! write the remaining data and the end marker, the compressor can be reused after this
+    void lzf::Compressor::finish(Buffer& output)
+    {
+        emit_block(pending.data(), pending.size(), output);
+        pending.clear();
+
+        detail::write_end_marker(output, total);
+
+        total = 0;
+        started = false;
+    }
+
+    //! number of bytes given to the compressor since the start of the stream
+    uint64_t lzf::Compressor::total_in() const noexcept
+    {
+        return total;
+    }
+
+    bool lzf::Decompressor::fail() noexcept
+    {
+        error = true;
+        pending.clear();
+        consumed = 0;
+        return false;
+    }
+
+    /**
+     * @brief Add input to the stream
+     *
+     * @param data      input data
+     * @param len       length of the input
+     * @param output    decompressed data of complete blocks is appended here
+     *
+     * @return false if the input is not valid framed data, the decompressor stays
+     *         failed after that
+     */
+    bool lzf::Decompressor::write(const uint8_t* data, size_t len, Buffer& output)
+    {
+        if (error)
+            return false;
+
+        if (done)
+            return len == 0 || fail();
+
+        // decode straight from the caller's data unless a partial block is waiting
+        const bool buffered = consumed != pending.size();
+        if (buffered)
+        {
+            pending.insert(pending.end(), data, data + len);
+            data = pending.data() + consumed;
+            len = pending.size() - consumed;
+        }
+
+        const uint8_t* ip = data;
+        size_t avail = len;
+
+        while (true)
+        {
+            if (!header_read)
+            {
+                if (avail < FRAME_HEADER_SIZE)
+                    break;
+
+                if (!detail::check_frame_header(ip))
+                    return fail();
+
+                ip += FRAME_HEADER_SIZE;
+                avail -= FRAME_HEADER_SIZE;
+                header_read = true;
+                continue;
+            }
+
+            if (avail < 1)
+                break;
+
+            if (ip[0] == BLOCK_END)
+            {
+                if (avail < END_MARKER_SIZE)
+                    break;
+
+                if (detail::load<uint64_t>(ip + 1, false) != total)
+                    return fail();
+
+                if (avail != END_MARKER_SIZE)
+                    return fail();
+
+                ip += END_MARKER_SIZE;
+                avail = 0;
+                done = true;
+                break;
+            }
+
+            if (avail < BLOCK_HEADER_SIZE)
+                break;
+
+            detail::BlockHeader header;
+            if (!detail::parse_block_header(ip, header))
+                return fail();
+
+            if (avail - BLOCK_HEADER_SIZE < header.stored_size)
+                break;
+
+            size_t start = output.size();
+            uint8_t* dst = output.append_uninitialized(decompress_bound(header.raw_size));
+
+            if (!detail::read_block(header, ip + BLOCK_HEADER_SIZE, dst, decompress_bound(header.raw_size)))
+            {
+                output.resize(start);
+                return fail();
+            }
+
+            output.resize(start + header.raw_size);
+
+            total += header.raw_size;
+            ip += BLOCK_HEADER_SIZE + header.stored_size;
+            avail -= BLOCK_HEADER_SIZE + header.stored_size;
+        }
+
+        if (!buffered)
+        {
+            // keep the incomplete tail for the next call
+            pending.assign(ip, ip + avail);
+            consumed = 0;
+            return true;
+        }
+
+        consumed = ip - pending.data();
+
+        // drop consumed input once it is the larger part of the buffer
+        if (consumed != 0 && consumed >= pending.size() / 2)
+        {
+            pending.erase(pending.begin(), pending.begin() + consumed);
+            consumed = 0;
+        }
+
+        return true;
+    }
+
+    bool lzf::Decompressor::write(const Buffer& input, Buffer& output)
+    {
+        return write(input.data(), input.size(), output);
+    }
+
+    //! true once the end marker has been read
+    bool lzf::Decompressor::finished() const noexcept
+    {
+        return done;
+    }
+
+    bool lzf::Decompressor::failed() const noexcept
+    {
+        return error;
+    }
+
+    //! number of bytes decompressed since the start of the stream
+    uint64_t lzf::Decompressor::total_out() const noexcept
+    {
+        return total;
+    }
+
+    Buffer lzf::compress_framed(const Buffer& input, size_t block_size, Level level, Entropy entropy)
+    {
+        // the same clamp as the Compressor, before the size estimate divides by it
+        block_size = block_size == 0 ? 1 : std::min(block_size, MAX_BLOCK_SIZE);
+
+        Buffer output;
+        output.reserve(FRAME_HEADER_SIZE + input.size() + input.size() / block_size * BLOCK_HEADER_SIZE + 64);
+
+        Compressor compressor(block_size, level, entropy);
+        compressor.write(input, output);
+        compressor.finish(output);
+
+        return output;
+    }
+
+    Result<Buffer> lzf::uncompress_framed(const Buffer& input)
+    {
+        Buffer output;
+        Decompressor decompressor;
+
+        if (!decompressor.write(input, output))
+            return Error("corrupt frame");
+
+        if (!decompressor.finished())
+            return Error("truncated frame");
+
+        return output;
+    }
+
+    // LZ4 block format
+
+    namespace detail
+    {
+        inline uint32_t lz4_hash(const uint8_t* p) noexcept
+        {
+            return (load<uint32_t>(p, false) * 2654435761u) >> (32 - lz4::HASH_LOG);
+        }
+
+        // write the part of a length that did not fit into the token
+        inline void lz4_write_length(uint8_t*& op, size_t len) noexcept
+        {
+            while (len >= 255)
+            {
+                *op++ = 255;
+                len -= 255;
+            }
+            *op++ = (uint8_t)len;
+        }
+
+        // read the rest of a length that did not fit into the token, false on truncated input
+        inline bool lz4_read_length(const uint8_t*& ip, const uint8_t* ip_end, size_t& len) noexcept
+        {
+            uint8_t byte;
+            do
+            {
+                if (ip == ip_end)
+                    return false;
+
+                byte = *ip++;
+                len += byte;
+            }
+            while (byte == 255);
+
+            return true;
+        }
+
+        // LZ4 block compressor, table has 1 << lz4::HASH_LOG entries of position + base,
+        // entries below base are left from earlier inputs
+        int lz4_compress(const uint8_t* src, int length, uint8_t* dst, int maxout, uint32_t* table, uint32_t base)
+        {
+            const uint8_t* ip = src;
+            const uint8_t* anchor = src;
+            const uint8_t* const ip_end = src + length;
+            const uint8_t* const mf_limit = ip_end - lz4::MF_LIMIT;
+            const uint8_t* const match_limit = ip_end - lz4::LAST_LITERALS;
+
+            uint8_t* op = dst;
+            uint8_t* const op_end = dst + maxout;
+
+            if (length > (int)lz4::MF_LIMIT)
+            {
+                table[lz4_hash(ip)] = base;
+                ++ip;
+
+                while (true)
+                {
+                    const uint8_t* ref;
+
+                    // find a match, stepping further the longer nothing is found
+                    uint32_t attempts = 1 << 6;
+                    while (true)
+                    {
+                        if (ip > mf_limit)
+                            goto last_literals;
+
+                        uint32_t h = lz4_hash(ip);
+                        uint32_t entry = table[h];
+                        table[h] = (ip - src) + base;
+
+                        if (entry >= base)
+                        {
+                            ref = src + (entry - base);
+                            if (ip - ref <= (ptrdiff_t)lz4::MAX_DISTANCE && load<uint32_t>(ref, false) == load<uint32_t>(ip, false))
+                                break;
+                        }
+
+                        ip += attempts++ >> 6;
+                    }
+
+                    // the match may start earlier than where it was found
+                    while (ip > anchor && ref > src && ip[-1] == ref[-1])
+                    {
+                        --ip;
+                        --ref;
+                    }
+
+                    size_t literals = ip - anchor;
+                    size_t match = lz4::MIN_MATCH + common_length(ip + lz4::MIN_MATCH, ref + lz4::MIN_MATCH,
+                                                                  match_limit - ip - lz4::MIN_MATCH);
+
+                    if ((size_t)(op_end - op) < 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1)
+                        return 0;
+
+                    uint8_t* token = op++;
+
+                    if (literals >= 15) {
+                        *token = 15 << 4;
+                        lz4_write_length(op, literals - 15);
+                    } else {
+                        *token = literals << 4;
+                    }
+
+                    memcpy(op, anchor, literals);
+                    op += literals;
+
+                    store<uint16_t>(op, (uint16_t)(ip - ref), false);
+                    op += 2;
+
+                    if (match - lz4::MIN_MATCH >= 15) {
+                        *token |= 15;
+                        lz4_write_length(op, match - lz4::MIN_MATCH - 15);
+                    } else {
+                        *token |= match - lz4::MIN_MATCH;
+                    }
+
+                    ip += match;
+                    anchor = ip;
+
+                    if (ip > mf_limit)
+                        break;
+
+                    table[lz4_hash(ip - 2)] = (ip - 2 - src) + base;
+                }
+            }
+
+        last_literals:
+            size_t literals = ip_end - anchor;
+
+            if ((size_t)(op_end - op) < 1 + literals / 255 + 1 + literals)
+                return 0;
+
+            if (literals >= 15) {
+                *op++ = 15 << 4;
+                lz4_write_length(op, literals - 15);
+            } else {
+                *op++ = literals << 4;
+            }
+
+            memcpy(op, anchor, literals);
+            op += literals;
+
+            return op - dst;
+        }
+
+        // LZ4 block decoder, copies in whole words while the output has room for it
+        int lz4_decompress(const uint8_t* src, int length, uint8_t* dst, int maxout)
+        {
+            const uint8_t* ip = src;
+            const uint8_t* const ip_end = src + length;
+            uint8_t* op = dst;
+            uint8_t* const op_end = dst + maxout;
+
+            while (ip < ip_end)
+            {
+                uint32_t token = *ip++;
+
+                size_t literals = token >> 4;
+                if (literals == 15 && !lz4_read_length(ip, ip_end, literals))
+                    return 0;
+
+                if ((size_t)(ip_end - ip) < literals || (size_t)(op_end - op) < literals)
+                    return 0;
+
+                if (literals <= 16 && ip_end - ip >= 16 && op_end - op >= 16)
+                    memcpy(op, ip, 16);
+                else
+                    memcpy(op, ip, literals);
+
+                op += literals;
+                ip += literals;
+
+                // the last sequence has no match
+                if (ip == ip_end)
+                    return op - dst;
+
+                if (ip_end - ip < 2)
+                    return 0;
+
+                size_t distance = load<uint16_t>(ip, false);
+                ip += 2;
+
+                size_t len = token & 15;
+                if (len == 15 && !lz4_read_length(ip, ip_end, len))
+                    return 0;
+                len += lz4::MIN_MATCH;
+
+                if (distance == 0 || distance > (size_t)(op - dst) || (size_t)(op_end - op) < len)
+                    return 0;
+
+                // most matches are short, two fixed-size copies cover them without branching
+                if (distance >= 8 && len <= 16 && op_end - op >= 16) {
+                    memcpy(op, op - distance, 8);
+                    memcpy(op + 8, op - distance + 8, 8);
+                } else {
+                    copy_match(op, distance, len, op_end - op);
+                }
+
+                op += len;
+            }
+
+            // a block always ends with literals
+            return 0;
+        }
+
+        inline lz4::Context& lz4_thread_context()
+        {
+            thread_local lz4::Context context;
+            return context;
+        }
+    }
+
+    lz4::Context::Context()
+        : table(new uint32_t[1 << HASH_LOG]())
+    {
+    }
+
+    // base for an input of len bytes, clears the table once the offsets would wrap
+    uint32_t lz4::Context::claim(size_t len)
+    {
+        if ((uint64_t)base + len >= UINT32_MAX)
+        {
+            std::fill(table.get(), table.get() + (1 << HASH_LOG), 0);
+            base = 1;
+        }
+
+        uint32_t rval = base;
+        base += len;
+        return rval;
+    }
+
+    /**
+     * @brief Compress into an LZ4 block in caller-provided memory
+     *
+     * @param src       input data
+     * @param len       length of the input
+     * @param dst       where to write the block
+     * @param capacity  room in dst, compress_bound(len) is always enough
+     *
+     * @return size of the block, 0 if it did not fit into capacity
+     */
+    size_t lz4::Context::compress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity)
+    {
+        if (len == 0 || len > INT32_MAX)
+            return 0;
+
+        int maxout = (int)std::min<size_t>(capacity, INT32_MAX);
+        return detail::lz4_compress(src, (int)len, dst, maxout, table.get(), claim(len));
+    }
+
+    size_t lz4::compress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity)
+    {
+        return detail::lz4_thread_context().compress_into(src, len, dst, capacity);
+    }
+
+    /**
+     * @brief Decompress an LZ4 block into caller-provided memory
+     *
+     * @return size of the decompressed data, 0 if the block is corrupt or the data did
+     *         not fit into capacity
+     */
+    size_t lz4::decompress_into(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity)
+    {
+        if (len == 0 || len > INT32_MAX)
+            return 0;
+
+        return detail::lz4_decompress(src, (int)len, dst, (int)std::min<size_t>(capacity, INT32_MAX));
+    }
+
+    // Codecs
+
+    const char* LZFCodec::name() const noexcept
+    {
+        return level == lzf::Level::high ? "lzf-high" : "lzf";
+    }
+
+    size_t LZFCodec::bound(size_t len) const noexcept
+    {
+        return lzf::compress_bound(len);
+    }
+
+    size_t LZFCodec::compress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) const
+    {
+        return lzf::compress_into(src, len, dst, capacity, level);
+    }
+
+    size_t LZFCodec::decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) const
+    {
+        return lzf::decompress_into(src, len, dst, capacity);
+    }
+
+    const char* LZ4Codec::name() const noexcept
+    {
+        return "lz4";
+    }
+
+    size_t LZ4Codec::bound(size_t len) const noexcept
+    {
+        return lz4::compress_bound(len);
+    }
+
+    size_t LZ4Codec::compress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) const
+    {
+        return lz4::compress_into(src, len, dst, capacity);
+    }
+
+    size_t LZ4Codec::decompress(const uint8_t* src, size_t len, uint8_t* dst, size_t capacity) const
+    {
+        return lz4::decompress_into(src, len, dst, capacity);
+    }
+
+    const Codec* find_codec(const std::string& name)
+    {
+        static const LZFCodec lzf_fast(lzf::Level::fast);
+        static const LZFCodec lzf_high(lzf::Level::high);
+        static const LZ4Codec lz4_block;
+
+        for (const Codec* codec : { (const Codec*)&lzf_fast, (const Codec*)&lzf_high, (const Codec*)&lz4_block })
+            if (name == codec->name())
+                return codec;
+
+        return nullptr;
     }
 }
 #endif
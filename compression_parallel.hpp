@@ -0,0 +1,268 @@
+/*!
+ * \file compression_parallel.hpp
+ * \brief Framed LZF compression and decompression spread over a thread_pool
+ *
+ * Kept apart from compression.hpp so that it does not depend on threadpool.hpp.  The
+ * implementations are compiled with the rest of compression.hpp, in the translation unit
+ * that defines MUSH_IMPLEMENT_COMPRESSION.  The output is the framed format of
+ * lzf::compress_framed(), either side can be done with or without threads.
+ *
+ *  mush::thread_pool pool;
+ *  mush::Buffer packed = mush::lzf::compress_parallel(data, pool);
+ */
+
+#ifndef MUSH_COMPRESSION_PARALLEL
+#define MUSH_COMPRESSION_PARALLEL
+
+#include <deque>
+#include <exception>
+
+#include "compression.hpp"
+#include "threadpool.hpp"
+
+namespace mush
+{
+    namespace lzf
+    {
+        constexpr size_t   PARALLEL_BLOCK_SIZE = 1 << 18;
+
+        // Framed format, blocks are compressed or decompressed concurrently on the pool
+        Buffer compress_parallel(const Buffer& input, thread_pool& pool, size_t block_size = PARALLEL_BLOCK_SIZE,
+                                 Level level = Level::fast, Entropy entropy = Entropy::none);
+        Result<Buffer> uncompress_parallel(const Buffer& input, thread_pool& pool);
+    }
+}
+
+#ifdef MUSH_MAKE_IMPLEMENTATIONS
+#define MUSH_IMPLEMENT_COMPRESSION
+#endif
+
+#ifdef MUSH_IMPLEMENT_COMPRESSION
+
+namespace mush
+{
+    /**
+     * @brief Compress into the framed format using several threads
+     *
+     * The input is split into independent blocks that are compressed as pool tasks and
+     * appended in order.  The result is identical to compress_framed() with the same
+     * block size.
+     *
+     * @param input         data to compress
+     * @param pool          threads to use, if the pool is stopped the work is done on
+     *                      the calling thread
+     * @param block_size    uncompressed size of each block
+     * @param level         compression level
+     * @param entropy       entropy coding stage for the blocks
+     */
+    Buffer lzf::compress_parallel(const Buffer& input, thread_pool& pool, size_t block_size, Level level, Entropy entropy)
+    {
+        block_size = block_size == 0 ? 1 : std::min(block_size, MAX_BLOCK_SIZE);
+
+        const uint8_t* data = input.data();
+        size_t block_count = (input.size() + block_size - 1) / block_size;
+
+        // keep a limited number of compressed blocks waiting to be appended
+        size_t in_flight = std::max<size_t>(pool.size() * 2, 2);
+
+        auto compress_one = [data, size = input.size(), block_size, level, entropy](size_t index)
+        {
+            size_t offset = index * block_size;
+            size_t len = std::min(block_size, size - offset);
+
+            Buffer block;
+            block.reserve(BLOCK_HEADER_SIZE + len);
+            detail::write_block(data + offset, len, block, detail::thread_context(), level, entropy);
+            return block;
+        };
+
+        Buffer output;
+        output.reserve(FRAME_HEADER_SIZE + input.size() + block_count * BLOCK_HEADER_SIZE + END_MARKER_SIZE);
+        detail::write_frame_header(output);
+
+        std::deque<std::future<Buffer>> pending;
+        size_t next = 0;
+
+        try
+        {
+            while (next < block_count || !pending.empty())
+            {
+                while (next < block_count && pending.size() < in_flight)
+                {
+                    auto task = pool.enqueue(compress_one, next);
+                    if (task)
+                    {
+                        pending.push_back(task.unwrap());
+                    }
+                    else
+                    {
+                        std::promise<Buffer> inline_result;
+                        inline_result.set_value(compress_one(next));
+                        pending.push_back(inline_result.get_future());
+                    }
+                    ++next;
+                }
+
+                Buffer block = pending.front().get();
+                pending.pop_front();
+
+                output.insert(output.end(), block.begin(), block.end());
+            }
+        }
+        catch (...)
+        {
+            // the remaining tasks still read the input, let them finish first
+            for (std::future<Buffer>& block : pending)
+                if (block.valid())
+                    block.wait();
+
+            throw;
+        }
+
+        detail::write_end_marker(output, input.size());
+
+        return output;
+    }
+
+    /**
+     * @brief Decompress framed data using several threads
+     *
+     * All block headers are checked first, then every block is decompressed as a pool
+     * task straight into its place in the output.
+     */
+    Result<Buffer> lzf::uncompress_parallel(const Buffer& input, thread_pool& pool)
+    {
+        struct Job
+        {
+            detail::BlockHeader header;
+            const uint8_t*      src;
+            size_t              offset;
+        };
+
+        std::vector<Job> jobs;
+
+        const uint8_t* ip = input.data();
+        const uint8_t* ip_end = ip + input.size();
+
+        if (input.size() < FRAME_HEADER_SIZE || !detail::check_frame_header(ip))
+            return Error("corrupt frame");
+
+        ip += FRAME_HEADER_SIZE;
+
+        uint64_t total = 0;
+        while (true)
+        {
+            size_t avail = ip_end - ip;
+
+            if (avail == 0)
+                return Error("truncated frame");
+
+            if (ip[0] == BLOCK_END)
+            {
+                if (avail < END_MARKER_SIZE)
+                    return Error("truncated frame");
+
+                if (avail != END_MARKER_SIZE || detail::load<uint64_t>(ip + 1, false) != total)
+                    return Error("corrupt frame");
+
+                break;
+            }
+
+            if (avail < BLOCK_HEADER_SIZE)
+                return Error("truncated frame");
+
+            Job job;
+            if (!detail::parse_block_header(ip, job.header))
+                return Error("corrupt frame");
+
+            if (avail - BLOCK_HEADER_SIZE < job.header.stored_size)
+                return Error("truncated frame");
+
+            job.src = ip + BLOCK_HEADER_SIZE;
+            job.offset = total;
+            jobs.push_back(job);
+
+            total += job.header.raw_size;
+            ip += BLOCK_HEADER_SIZE + job.header.stored_size;
+        }
+
+        // blocks are written concurrently, so only the last one gets the slack
+        Buffer output;
+        output.resize_uninitialized(decompress_bound(total));
+
+        uint8_t* dst = output.data();
+        auto decompress_one = [dst, total](const Job& job)
+        {
+            size_t capacity = job.offset + job.header.raw_size == total ? decompress_bound(job.header.raw_size)
+                                                                         : job.header.raw_size;
+            return detail::read_block(job.header, job.src, dst + job.offset, capacity);
+        };
+
+        std::vector<std::future<bool>> results;
+        results.reserve(jobs.size());
+
+        bool ok = true;
+        std::exception_ptr failure;
+        try
+        {
+            for (const Job& job : jobs)
+            {
+                auto task = pool.enqueue(decompress_one, job);
+                if (task)
+                    results.push_back(task.unwrap());
+                else
+                    ok &= decompress_one(job);
+            }
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+
+        // wait for every task before returning or throwing, they write into output
+        for (std::future<bool>& result : results)
+        {
+            try
+            {
+                ok &= result.get();
+            }
+            catch (...)
+            {
+                if (!failure)
+                    failure = std::current_exception();
+            }
+        }
+
+        if (failure)
+            std::rethrow_exception(failure);
+
+        if (!ok)
+            return Error("corrupt frame");
+
+        output.resize(total);
+        return output;
+    }
+}
+#endif
+#endif
+/*
+ Copyright (c) 2017 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,82 @@
+/*!
+ * \file compression_pool.hpp
+ * \brief LZF compress and uncompress overloads taking their output from a BufferPool
+ *
+ * Kept apart from compression.hpp so that it does not depend on buffer_pool.hpp.  The
+ * implementations are compiled with the rest of compression.hpp, in the translation unit
+ * that defines MUSH_IMPLEMENT_COMPRESSION.
+ *
+ *  mush::BufferPool pool;
+ *  mush::Buffer packed = mush::lzf::compress(data, pool);
+ *  ...
+ *  pool.release(std::move(packed));
+ */
+
+#ifndef MUSH_COMPRESSION_POOL
+#define MUSH_COMPRESSION_POOL
+
+#include "compression.hpp"
+#include "buffer_pool.hpp"
+
+namespace mush
+{
+    namespace lzf
+    {
+        // Output buffer is acquired from the pool, release it back when done
+        Buffer compress(const Buffer& input, BufferPool& pool, Level level = Level::fast);
+        Buffer uncompress(const Buffer& input, BufferPool& pool);
+    }
+}
+
+#ifdef MUSH_MAKE_IMPLEMENTATIONS
+#define MUSH_IMPLEMENT_COMPRESSION
+#endif
+
+#ifdef MUSH_IMPLEMENT_COMPRESSION
+
+namespace mush
+{
+    Buffer lzf::compress(const Buffer& input, BufferPool& pool, Level level)
+    {
+        Buffer output = pool.acquire(input.size() + 5);
+        compress(input, output, level);
+
+        return output;
+    }
+
+    Buffer lzf::uncompress(const Buffer& input, BufferPool& pool)
+    {
+        size_t unpacked_size = input.size() < 4 ? 0 : input[0] | (input[1] << 8) | (input[2] << 16) | ((size_t)input[3] << 24);
+
+        // the decoder wants decompress_bound() room, acquire that so it does not reallocate,
+        // but no more than the input can decode to in case the header is corrupt
+        size_t in_len = input.size() < 5 ? 0 : input.size() - 5;
+        Buffer output = pool.acquire(decompress_bound(std::min<size_t>(unpacked_size, in_len * MAX_EXPANSION)));
+        uncompress(input, output);
+
+        return output;
+    }
+}
+#endif
+#endif
+/*
+ Copyright (c) 2017 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,287 @@
+/*!
+ * \file hash.hpp
+ * \brief Contains the hash algorithms and the Hash template used by Buffer and String
+ * \author Jari Ronkainen
+ * \version 1.0
+ *
+ * Two algorithms are provided:
+ *  - hashes::fnv1a, byte-at-a-time FNV-1a, the default
+ *  - hashes::wyhash, a word-at-a-time 64-bit hash based on wyhash, much faster for
+ *    anything longer than a few bytes
+ *
+ * The algorithm is selected with the last parameter of the Hash template, e.g.
+ *
+ *  std::unordered_map<mush::Buffer, int, mush::hashes::Hash<mush::Buffer, mush::size_t_x64(), mush::hashes::wyhash>>
+ *
+ * hashes::Cached wraps a key and remembers its hash until the key is modified.
+ */
+
+#ifndef MUSH_HASH
+#define MUSH_HASH
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cassert>
+#include <utility>
+#include <type_traits>
+#include <functional>
+
+namespace mush
+{
+    // Required for hash functions
+    constexpr bool size_t_x64() noexcept
+    { return sizeof(size_t) == 8 ? true : false; }
+
+    namespace hashes
+    {
+        //! algorithm tag for FNV-1a
+        struct fnv1a {};
+
+        //! algorithm tag for wyhash
+        struct wyhash {};
+
+        // This voodoo is to find out whether size_t is 8 or 4 bytes long, it could be
+        // easily extended to different sizes, but for now this is enough.
+        template<typename T, bool is_x86_64 = size_t_x64(), typename Algorithm = fnv1a>
+        class Hash
+        {
+            public:
+            size_t operator()(const T&)
+            {
+                assert(0 && "unknown bit depth");
+            }
+        };
+
+        namespace detail
+        {
+            // 64x64 -> 128-bit multiply, low half to a and high half to b
+            inline void mum(uint64_t& a, uint64_t& b) noexcept
+            {
+                #if defined(__SIZEOF_INT128__)
+                __uint128_t r = a;
+                r *= b;
+                a = static_cast<uint64_t>(r);
+                b = static_cast<uint64_t>(r >> 64);
+                #else
+                uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+                uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+                uint64_t t = rl + (rm0 << 32);
+                uint64_t c = t < rl;
+                uint64_t lo = t + (rm1 << 32);
+                c += lo < t;
+                a = lo;
+                b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+                #endif
+            }
+
+            inline uint64_t mix(uint64_t a, uint64_t b) noexcept
+            {
+                mum(a, b);
+                return a ^ b;
+            }
+
+            inline uint64_t read8(const uint8_t* p) noexcept { uint64_t v; memcpy(&v, p, 8); return v; }
+            inline uint64_t read4(const uint8_t* p) noexcept { uint32_t v; memcpy(&v, p, 4); return v; }
+            inline uint64_t read3(const uint8_t* p, size_t k) noexcept
+            {
+                return (uint64_t(p[0]) << 16) | (uint64_t(p[k >> 1]) << 8) | p[k - 1];
+            }
+
+            constexpr uint64_t secret[4] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+                                             0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+        }
+
+        //! FNV-1a of a byte range, in the width of size_t
+        inline size_t fnv1a_bytes(const void* data, size_t len) noexcept
+        {
+            const uint8_t* bytep = static_cast<const uint8_t*>(data);
+
+            if constexpr (size_t_x64())
+            {
+                uint64_t hash = 0xCBF29CE484222325;
+                constexpr uint64_t prime = 0x100000001B3;
+
+                for (size_t it = 0; it < len; ++it)
+                    hash = (hash ^ bytep[it]) * prime;
+
+                return static_cast<size_t>(hash);
+            } else {
+                uint32_t hash = 0x811C9DC5;
+                constexpr uint32_t prime = 0x1000193;
+
+                for (size_t it = 0; it < len; ++it)
+                    hash = (hash ^ bytep[it]) * prime;
+
+                return static_cast<size_t>(hash);
+            }
+        }
+
+        /**
+         * @brief 64-bit word-at-a-time hash of a byte range
+         *
+         * Reads 16 or 48 bytes per round with 64-bit loads and mixes them with 128-bit
+         * multiplies.  Inputs up to 16 bytes are handled with a couple of overlapping
+         * loads and no loop at all.
+         */
+        inline uint64_t wyhash_bytes(const void* data, size_t len, uint64_t seed = 0) noexcept
+        {
+            using detail::mix;
+            using detail::read8;
+            using detail::read4;
+            using detail::secret;
+
+            const uint8_t* p = static_cast<const uint8_t*>(data);
+            seed ^= mix(seed ^ secret[0], secret[1]);
+
+            uint64_t a, b;
+            if (len <= 16)
+            {
+                if (len >= 4)
+                {
+                    a = (read4(p) << 32) | read4(p + ((len >> 3) << 2));
+                    b = (read4(p + len - 4) << 32) | read4(p + len - 4 - ((len >> 3) << 2));
+                }
+                else if (len > 0)
+                {
+                    a = detail::read3(p, len);
+                    b = 0;
+                }
+                else
+                {
+                    a = b = 0;
+                }
+            }
+            else
+            {
+                size_t i = len;
+                if (i > 48)
+                {
+                    uint64_t see1 = seed, see2 = seed;
+                    do
+                    {
+                        seed = mix(read8(p) ^ secret[1], read8(p + 8) ^ seed);
+                        see1 = mix(read8(p + 16) ^ secret[2], read8(p + 24) ^ see1);
+                        see2 = mix(read8(p + 32) ^ secret[3], read8(p + 40) ^ see2);
+                        p += 48;
+                        i -= 48;
+                    }
+                    while (i > 48);
+                    seed ^= see1 ^ see2;
+                }
+
+                while (i > 16)
+                {
+                    seed = mix(read8(p) ^ secret[1], read8(p + 8) ^ seed);
+                    i -= 16;
+                    p += 16;
+                }
+
+                a = read8(p + i - 16);
+                b = read8(p + i - 8);
+            }
+
+            a ^= secret[1];
+            b ^= seed;
+            detail::mum(a, b);
+
+            return mix(a ^ secret[0] ^ len, b ^ secret[1]);
+        }
+
+        //! hash a byte range with the given algorithm
+        template <typename Algorithm>
+        inline size_t hash_bytes(const void* data, size_t len) noexcept
+        {
+            if constexpr (std::is_same<Algorithm, wyhash>::value)
+                return static_cast<size_t>(wyhash_bytes(data, len));
+            else
+                return fnv1a_bytes(data, len);
+        }
+
+        /**
+         * @brief Key wrapper that caches its hash
+         *
+         * The hash is computed on first use and kept until the value is modified through
+         * mutate() or assign(), both of which invalidate it.  Read access through get()
+         * never does.  Meant as unordered_map key for long keys that are looked up often.
+         */
+        template <typename T, typename Algorithm = wyhash>
+        class Cached
+        {
+            public:
+                Cached() = default;
+                Cached(const T& value) : value(value) {}
+                Cached(T&& value) : value(std::move(value)) {}
+
+                const T&    get() const noexcept        { return value; }
+                operator    const T&() const noexcept   { return value; }
+
+                //! access for modification, invalidates the cached hash
+                T&          mutate() noexcept           { valid = false; return value; }
+
+                void        assign(T new_value)         { value = std::move(new_value); valid = false; }
+
+                bool        has_cached_hash() const noexcept { return valid; }
+
+                size_t      hash() const noexcept
+                {
+                    if (!valid)
+                    {
+                        cached = Hash<T, size_t_x64(), Algorithm>()(value);
+                        valid = true;
+                    }
+                    return cached;
+                }
+
+                bool operator==(const Cached& rhs) const
+                {
+                    if (valid && rhs.valid && cached != rhs.cached)
+                        return false;
+
+                    return value == rhs.value;
+                }
+
+                bool operator!=(const Cached& rhs) const { return !(*this == rhs); }
+
+            private:
+                T               value;
+                mutable size_t  cached = 0;
+                mutable bool    valid = false;
+        };
+    }
+}
+
+namespace std
+{
+    template<typename T, typename Algorithm>
+    struct hash<mush::hashes::Cached<T, Algorithm>>
+    {
+        size_t operator()(const mush::hashes::Cached<T, Algorithm>& __s) const noexcept
+        {
+            return __s.hash();
+        }
+    };
+}
+
+#endif
+/*
+ Copyright (c) 2017 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -0,0 +1,248 @@
+/*!
+ * \file mapped_buffer.hpp
+ * \brief Contains the MappedBuffer class for read-only memory-mapped files
+ * \author Jari Ronkainen
+ * \version 1.0
+ *
+ * MappedBuffer maps a file into memory instead of reading it like file_to_buffer does.
+ * Nothing is read up front, pages are faulted in by the kernel when they are first
+ * touched, so opening even a very large file is cheap and only the parts actually
+ * read count towards the resident memory.
+ *
+ * MappedBuffer is a BufferView, so it has the same read and seek interface as Buffer.
+ *
+ * Requires a POSIX system (mmap and madvise).
+ */
+
+#ifndef MUSH_MAPPED_BUFFER
+#define MUSH_MAPPED_BUFFER
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "buffer.hpp"
+
+namespace mush
+{
+    //! Hints for the kernel about how a mapping is going to be accessed
+    enum class access_pattern
+    {
+        normal,
+        sequential,
+        random,
+        will_need,
+        dont_need
+    };
+
+    /**
+     * @brief Read-only view to a memory-mapped file
+     */
+    class MappedBuffer : public BufferView
+    {
+        public:
+            MappedBuffer() noexcept = default;
+            MappedBuffer(const char* filename, access_pattern hint = access_pattern::sequential) noexcept;
+           ~MappedBuffer();
+
+            MappedBuffer(const MappedBuffer&) = delete;
+            MappedBuffer& operator=(const MappedBuffer&) = delete;
+
+            MappedBuffer(MappedBuffer&& other) noexcept;
+            MappedBuffer& operator=(MappedBuffer&& other) noexcept;
+
+            bool            open(const char* filename, access_pattern hint = access_pattern::sequential) noexcept;
+            void            close() noexcept;
+
+            bool            is_open() const noexcept;
+            explicit        operator bool() const noexcept;
+
+            bool            advise(access_pattern hint) const noexcept;
+            bool            advise(size_t offset, size_t len, access_pattern hint) const noexcept;
+
+        private:
+            void*           mapping = nullptr;
+            size_t          mapped_size = 0;
+            bool            opened = false;
+    };
+
+    // IMPLEMENTATIONS
+
+    namespace detail
+    {
+        inline int madvise_flag(access_pattern hint) noexcept
+        {
+            switch (hint)
+            {
+                case access_pattern::sequential:    return MADV_SEQUENTIAL;
+                case access_pattern::random:        return MADV_RANDOM;
+                case access_pattern::will_need:     return MADV_WILLNEED;
+                case access_pattern::dont_need:     return MADV_DONTNEED;
+                default:                            return MADV_NORMAL;
+            }
+        }
+    }
+
+    inline MappedBuffer::MappedBuffer(const char* filename, access_pattern hint) noexcept
+    {
+        open(filename, hint);
+    }
+
+    inline MappedBuffer::~MappedBuffer()
+    {
+        close();
+    }
+
+    inline MappedBuffer::MappedBuffer(MappedBuffer&& other) noexcept
+        : BufferView(other), mapping(other.mapping), mapped_size(other.mapped_size), opened(other.opened)
+    {
+        static_cast<BufferView&>(other) = BufferView();
+        other.mapping = nullptr;
+        other.mapped_size = 0;
+        other.opened = false;
+    }
+
+    inline MappedBuffer& MappedBuffer::operator=(MappedBuffer&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        close();
+
+        static_cast<BufferView&>(*this) = other;
+        mapping = other.mapping;
+        mapped_size = other.mapped_size;
+        opened = other.opened;
+
+        static_cast<BufferView&>(other) = BufferView();
+        other.mapping = nullptr;
+        other.mapped_size = 0;
+        other.opened = false;
+
+        return *this;
+    }
+
+    /**
+     * @brief Map a file into memory
+     *
+     * Any previously mapped file is unmapped first.  An empty file opens successfully
+     * and results in an empty view.
+     *
+     * @param filename  file name
+     * @param hint      expected access pattern, passed on to madvise
+     *
+     * @return true if the file was mapped, otherwise false
+     */
+    inline bool MappedBuffer::open(const char* filename, access_pattern hint) noexcept
+    {
+        close();
+
+        int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        size_t size = static_cast<size_t>(st.st_size);
+
+        if (size != 0)
+        {
+            void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr == MAP_FAILED)
+            {
+                ::close(fd);
+                return false;
+            }
+
+            mapping = addr;
+            mapped_size = size;
+        }
+
+        // the mapping stays valid after the descriptor is gone
+        ::close(fd);
+
+        static_cast<BufferView&>(*this) = BufferView(static_cast<const uint8_t*>(mapping), mapped_size);
+        opened = true;
+
+        advise(hint);
+
+        return true;
+    }
+
+    //! unmap the file, the buffer becomes empty
+    inline void MappedBuffer::close() noexcept
+    {
+        if (mapping != nullptr)
+            munmap(mapping, mapped_size);
+
+        static_cast<BufferView&>(*this) = BufferView();
+        mapping = nullptr;
+        mapped_size = 0;
+        opened = false;
+    }
+
+    inline bool MappedBuffer::is_open() const noexcept { return opened; }
+    inline MappedBuffer::operator bool() const noexcept { return opened; }
+
+    //! give the kernel a hint of how the whole mapping is going to be accessed
+    inline bool MappedBuffer::advise(access_pattern hint) const noexcept
+    {
+        return advise(0, mapped_size, hint);
+    }
+
+    /**
+     * @brief Give the kernel a hint of how part of the mapping is going to be accessed
+     *
+     * For example access_pattern::will_need starts reading the range in ahead of time
+     * and access_pattern::dont_need lets the kernel drop already read pages.
+     *
+     * @param offset    start of the range, rounded down to page boundary
+     * @param len       length of the range
+     * @param hint      expected access pattern
+     *
+     * @return true on success, otherwise false
+     */
+    inline bool MappedBuffer::advise(size_t offset, size_t len, access_pattern hint) const noexcept
+    {
+        if (mapping == nullptr || offset >= mapped_size)
+            return false;
+
+        if (len > mapped_size - offset)
+            len = mapped_size - offset;
+
+        size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        size_t aligned = offset - offset % page;
+
+        return madvise(static_cast<uint8_t*>(mapping) + aligned, len + (offset - aligned),
+                       detail::madvise_flag(hint)) == 0;
+    }
+}
+
+#endif
+/*
+ Copyright (c) 2017 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
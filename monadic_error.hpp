@@ -28,7 +28,11 @@ namespace mush
         bool has_value()    const { return flags & HAS_VALUE; }
         bool is_dirty()     const { return flags & NEED_CLEANUP; }
 
-        Result_Flags(bool value = false) { if (value) set_value(); }
+        Result_Flags(bool value = false, bool dirty = false)
+        {
+            if (value) set_value();
+            if (dirty) set_dirty();
+        }
     };
 
     template <typename ValueType, typename ErrorType, typename FlagType, bool ValueIsRef>
@@ -43,9 +47,12 @@ namespace mush
 
         constexpr Result_Storage() {}
 
+        // whatever is stored needs its destructor run unless it is trivial
         template <typename V = ValueType, typename std::enable_if_t<!std::is_same<V,ErrorType>::value, int> = 0>
-        constexpr Result_Storage(ValueType value) : value(std::move(value)), flags(true) {}
-        constexpr Result_Storage(ErrorType error) : error(std::move(error)), flags() {}
+        constexpr Result_Storage(ValueType value)
+            : value(std::move(value)), flags(true, !std::is_trivially_destructible<ValueType>::value) {}
+        constexpr Result_Storage(ErrorType error)
+            : error(std::move(error)), flags(false, !std::is_trivially_destructible<ErrorType>::value) {}
         
         void clean()
         {
@@ -69,7 +76,8 @@ namespace mush
         Result_Flags<FlagType> flags;
 
         constexpr Result_Storage(ValueType& ref) : flags(true) { value = &ref; }
-        constexpr Result_Storage(ErrorType error) : error(std::move(error)), flags() {}
+        constexpr Result_Storage(ErrorType error)
+            : error(std::move(error)), flags(false, !std::is_trivially_destructible<ErrorType>::value) {}
         
         void clean()
         {
@@ -125,7 +133,7 @@ namespace mush
                     stored.clean();
                     new (&stored.value) ValueType(std::move(in_value));
                     stored.flags.set_value();
-                    if constexpr(std::is_trivial<ValueType>::value) stored.flags.set_dirty();
+                    if constexpr(!std::is_trivially_destructible<ValueType>::value) stored.flags.set_dirty();
                 }
                 else if constexpr(std::is_convertible<T, ErrorType>::value)
                 {
@@ -169,10 +177,9 @@ namespace mush
                       typename std::enable_if_t<!std::is_void<V>::value, int> = 0>
             ValueType unwrap()
             {
-                if (*this) {
-                    stored.flags.clear_flags();
+                // the moved-from value is still destroyed with the result
+                if (*this)
                     return std::move(stored.value);
-                }
 
                 stored.clean();
                 std::abort();
@@ -0,0 +1,135 @@
+/*!
+ * \file schema.hpp
+ * \brief Contains the Schema template for reading and writing fixed-layout records
+ * \author Jari Ronkainen
+ * \version 1.0
+ *
+ * A Schema lists the fields of a struct in the order they are stored, once per struct:
+ *
+ *  struct Header { uint32_t signature; uint16_t version; uint16_t flags; };
+ *  using HeaderSchema = mush::Schema<&Header::signature, &Header::version, &Header::flags>;
+ *
+ * The whole record is then read or written with a single bounds check, followed by a
+ * straight-line sequence of loads or stores with the byte order handled per field:
+ *
+ *  Header h;
+ *  if (!buffer.read_record<HeaderSchema>(h))
+ *      ...
+ *
+ * Fields are packed back to back without padding, so the stored layout does not depend
+ * on the layout of the struct in memory.
+ */
+
+#ifndef MUSH_SCHEMA
+#define MUSH_SCHEMA
+
+#include "buffer.hpp"
+
+namespace mush
+{
+    namespace detail
+    {
+        template <typename M> struct member_pointer_traits {};
+
+        template <typename C, typename F>
+        struct member_pointer_traits<F C::*>
+        {
+            typedef C class_type;
+            typedef F field_type;
+        };
+
+        template <auto Member>
+        using field_type_t = typename member_pointer_traits<decltype(Member)>::field_type;
+
+        template <auto Member>
+        using class_type_t = typename member_pointer_traits<decltype(Member)>::class_type;
+    }
+
+    /**
+     * @brief Field list of a fixed-layout record
+     *
+     * @tparam First, Rest  pointers to data members of the record, in stored order
+     */
+    template <auto First, auto... Rest>
+    struct Schema
+    {
+        typedef detail::class_type_t<First> record_type;
+
+        static_assert((std::is_same<record_type, detail::class_type_t<Rest>>::value && ...),
+                      "all fields of a schema must belong to the same struct");
+
+        static_assert(std::is_trivially_copyable<detail::field_type_t<First>>::value
+                   && (std::is_trivially_copyable<detail::field_type_t<Rest>>::value && ...),
+                      "schema fields must be trivially copyable");
+
+        //! stored size of the record in bytes
+        constexpr static size_t size = (sizeof(detail::field_type_t<First>) + ... + sizeof(detail::field_type_t<Rest>));
+
+        //! number of fields in the record
+        constexpr static size_t field_count = 1 + sizeof...(Rest);
+
+        static void load(const uint8_t* src, record_type& record, bool big_endian_mode = false) noexcept;
+        static void store(uint8_t* dst, const record_type& record, bool big_endian_mode = false) noexcept;
+    };
+
+    // IMPLEMENTATIONS
+
+    /**
+     * @brief Load all fields of a record, src must hold at least size bytes
+     */
+    template <auto First, auto... Rest>
+    inline void Schema<First, Rest...>::load(const uint8_t* src, record_type& record, bool big_endian_mode) noexcept
+    {
+        auto field = [&](auto member)
+        {
+            typedef detail::field_type_t<decltype(member)::value> field_type;
+
+            record.*(decltype(member)::value) = detail::load<field_type>(src, big_endian_mode);
+            src += sizeof(field_type);
+        };
+
+        field(std::integral_constant<decltype(First), First>());
+        (field(std::integral_constant<decltype(Rest), Rest>()), ...);
+    }
+
+    /**
+     * @brief Store all fields of a record, dst must have room for size bytes
+     */
+    template <auto First, auto... Rest>
+    inline void Schema<First, Rest...>::store(uint8_t* dst, const record_type& record, bool big_endian_mode) noexcept
+    {
+        auto field = [&](auto member)
+        {
+            typedef detail::field_type_t<decltype(member)::value> field_type;
+
+            detail::store<field_type>(dst, record.*(decltype(member)::value), big_endian_mode);
+            dst += sizeof(field_type);
+        };
+
+        field(std::integral_constant<decltype(First), First>());
+        (field(std::integral_constant<decltype(Rest), Rest>()), ...);
+    }
+}
+
+#endif
+/*
+ Copyright (c) 2017 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
@@ -18,7 +18,7 @@ namespace mush
             void pop();
 
             void push(const T& item);
-            void push(T item);
+            void push(T&& item);
 
             int size();
             bool empty();
@@ -59,7 +59,7 @@ namespace mush
     }
 
     template <typename T>
-    void shared_queue<T>::push(T item)
+    void shared_queue<T>::push(T&& item)
     {
         std::unique_lock<std::mutex> lock(queue_lock);
         queue.push(std::move(item));
@@ -73,6 +73,13 @@ namespace mush
         std::unique_lock<std::mutex> lock(queue_lock);
         return queue.size();
     }
+
+    template <typename T>
+    bool shared_queue<T>::empty()
+    {
+        std::unique_lock<std::mutex> lock(queue_lock);
+        return queue.empty();
+    }
 }
 
 #endif
@@ -0,0 +1,576 @@
+/*!
+ * \file small_buffer.hpp
+ * \brief Contains the SmallBuffer class, a Buffer with inline storage for short data
+ * \author Jari Ronkainen
+ * \version 1.0
+ *
+ * SmallBuffer keeps up to InlineCapacity bytes inside the object itself and only moves
+ * to the heap once it grows larger than that.  Headers, length prefixes and other short
+ * values can then be encoded and decoded without touching the allocator at all.
+ *
+ * SmallBuffer has the same read and write functions as Buffer, apart from copy_until
+ * and copy_bytes which would return new buffers, view() gives a BufferView for those
+ * and for everything else.  Unlike Buffer it is not a std::vector, it only provides the
+ * common subset of the container interface.
+ */
+
+#ifndef MUSH_SMALL_BUFFER
+#define MUSH_SMALL_BUFFER
+
+#include <cstddef>
+#include <new>
+
+#include "buffer.hpp"
+
+namespace mush
+{
+    /**
+     * @brief Buffer with small-buffer optimisation
+     */
+    template <size_t InlineCapacity = 64>
+    class SmallBuffer
+    {
+        public:
+            typedef uint8_t         value_type;
+            typedef uint8_t&        reference;
+            typedef const uint8_t&  const_reference;
+            typedef uint8_t*        iterator;
+            typedef const uint8_t*  const_iterator;
+            typedef size_t          size_type;
+
+            constexpr static size_t inline_capacity = InlineCapacity;
+
+            SmallBuffer() noexcept = default;
+            SmallBuffer(const SmallBuffer& other);
+            SmallBuffer(SmallBuffer&& other) noexcept;
+            SmallBuffer(BufferView data);
+           ~SmallBuffer();
+
+            SmallBuffer& operator=(const SmallBuffer& other);
+            SmallBuffer& operator=(SmallBuffer&& other) noexcept;
+
+            uint8_t*        data() noexcept         { return ptr(); }
+            const uint8_t*  data() const noexcept   { return ptr(); }
+            size_t          size() const noexcept   { return length; }
+            size_t          capacity() const noexcept { return cap; }
+            bool            empty() const noexcept  { return length == 0; }
+            bool            is_inline() const noexcept { return heap == nullptr; }
+
+            iterator        begin() noexcept        { return ptr(); }
+            iterator        end() noexcept          { return ptr() + length; }
+            const_iterator  begin() const noexcept  { return ptr(); }
+            const_iterator  end() const noexcept    { return ptr() + length; }
+
+            uint8_t&        operator[](size_t index) noexcept       { return ptr()[index]; }
+            const uint8_t&  operator[](size_t index) const noexcept { return ptr()[index]; }
+
+            bool            operator==(const SmallBuffer& rhs) const noexcept;
+            bool            operator!=(const SmallBuffer& rhs) const noexcept;
+
+            void            reserve(size_t new_capacity);
+            void            resize(size_t new_size, uint8_t value = 0);
+            void            clear() noexcept;
+            void            shrink_to_fit();
+
+            void            push_back(uint8_t value);
+            void            append(const uint8_t* src, size_t len);
+
+            bool            can_read(size_t bytes) const noexcept;
+            size_t          pos() const noexcept;
+            void            seek(size_t target) const noexcept;
+
+            BufferView      view() const noexcept;
+            Buffer          to_buffer() const;
+
+            template <typename T>
+            T read(size_t where = MUSH_DEFAULT_LOC, bool big_endian_mode = false) const noexcept;
+
+            template <typename T>
+            T read_le(size_t where = MUSH_DEFAULT_LOC) const noexcept;
+
+            template <typename T>
+            bool read_array(T* dst, size_t count, bool big_endian_mode = false) const noexcept;
+
+            template <typename T>
+            T read_strval() const;
+
+            template <typename T>
+            Result<T> read_number() const;
+
+            BlockReader     read_block(size_t bytes) const noexcept;
+
+            template <typename T>
+            void write(T&& data, bool big_endian_mode = false);
+
+            template <typename T>
+            void write_le(T&& data);
+
+            template <typename T>
+            void write_array(const T* src, size_t count, bool big_endian_mode = false);
+
+            template <typename... T>
+            void write_bytes(T... bytes);
+
+            template <typename T>
+            T read_varint() const noexcept;
+
+            template <typename T>
+            bool read_varint(T& value) const noexcept;
+
+            template <typename T>
+            void write_varint(T value);
+
+            template <typename Schema>
+            bool read_record(typename Schema::record_type& record, bool big_endian_mode = false) const noexcept;
+
+            template <typename Schema>
+            void write_record(const typename Schema::record_type& record, bool big_endian_mode = false);
+
+        private:
+            uint8_t*        ptr() noexcept          { return heap ? heap : local; }
+            const uint8_t*  ptr() const noexcept    { return heap ? heap : local; }
+
+            void            grow(size_t min_capacity);
+
+            uint8_t*        heap = nullptr;
+            size_t          length = 0;
+            size_t          cap = InlineCapacity;
+            mutable size_t  read_ptr = 0;
+
+            alignas(std::max_align_t) uint8_t local[InlineCapacity];
+    };
+
+    // IMPLEMENTATIONS
+
+    template <size_t N>
+    inline SmallBuffer<N>::SmallBuffer(const SmallBuffer& other)
+    {
+        append(other.data(), other.size());
+        read_ptr = other.read_ptr;
+    }
+
+    template <size_t N>
+    inline SmallBuffer<N>::SmallBuffer(SmallBuffer&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    template <size_t N>
+    inline SmallBuffer<N>::SmallBuffer(BufferView data)
+    {
+        append(data.data(), data.size());
+    }
+
+    template <size_t N>
+    inline SmallBuffer<N>::~SmallBuffer()
+    {
+        if (heap != nullptr)
+            ::operator delete(heap);
+    }
+
+    template <size_t N>
+    inline SmallBuffer<N>& SmallBuffer<N>::operator=(const SmallBuffer& other)
+    {
+        if (this == &other)
+            return *this;
+
+        length = 0;
+        append(other.data(), other.size());
+        read_ptr = other.read_ptr;
+
+        return *this;
+    }
+
+    template <size_t N>
+    inline SmallBuffer<N>& SmallBuffer<N>::operator=(SmallBuffer&& other) noexcept
+    {
+        if (this == &other)
+            return *this;
+
+        if (heap != nullptr)
+            ::operator delete(heap);
+
+        if (other.heap != nullptr)
+        {
+            // steal the heap storage
+            heap = other.heap;
+            cap = other.cap;
+            other.heap = nullptr;
+            other.cap = N;
+        } else {
+            heap = nullptr;
+            cap = N;
+            memcpy(local, other.local, other.length);
+        }
+
+        length = other.length;
+        read_ptr = other.read_ptr;
+
+        other.length = 0;
+        other.read_ptr = 0;
+
+        return *this;
+    }
+
+    template <size_t N>
+    inline bool SmallBuffer<N>::operator==(const SmallBuffer& rhs) const noexcept
+    {
+        return length == rhs.length && (length == 0 || memcmp(ptr(), rhs.ptr(), length) == 0);
+    }
+
+    template <size_t N>
+    inline bool SmallBuffer<N>::operator!=(const SmallBuffer& rhs) const noexcept
+    {
+        return !(*this == rhs);
+    }
+
+    // move to a larger heap block, growing geometrically
+    template <size_t N>
+    inline void SmallBuffer<N>::grow(size_t min_capacity)
+    {
+        size_t new_capacity = cap * 2 > min_capacity ? cap * 2 : min_capacity;
+
+        uint8_t* block = static_cast<uint8_t*>(::operator new(new_capacity));
+        memcpy(block, ptr(), length);
+
+        if (heap != nullptr)
+            ::operator delete(heap);
+
+        heap = block;
+        cap = new_capacity;
+    }
+
+    template <size_t N>
+    inline void SmallBuffer<N>::reserve(size_t new_capacity)
+    {
+        if (new_capacity > cap)
+            grow(new_capacity);
+    }
+
+    template <size_t N>
+    inline void SmallBuffer<N>::resize(size_t new_size, uint8_t value)
+    {
+        if (new_size > cap)
+            grow(new_size);
+
+        if (new_size > length)
+            memset(ptr() + length, value, new_size - length);
+
+        length = new_size;
+    }
+
+    template <size_t N>
+    inline void SmallBuffer<N>::clear() noexcept
+    {
+        length = 0;
+        read_ptr = 0;
+    }
+
+    //! move back to inline storage if the data fits there
+    template <size_t N>
+    inline void SmallBuffer<N>::shrink_to_fit()
+    {
+        if (heap == nullptr || length > N)
+            return;
+
+        memcpy(local, heap, length);
+        ::operator delete(heap);
+
+        heap = nullptr;
+        cap = N;
+    }
+
+    template <size_t N>
+    inline void SmallBuffer<N>::push_back(uint8_t value)
+    {
+        if (length == cap)
+            grow(length + 1);
+
+        ptr()[length++] = value;
+    }
+
+    //! append raw bytes to the end of the buffer
+    template <size_t N>
+    inline void SmallBuffer<N>::append(const uint8_t* src, size_t len)
+    {
+        if (len == 0)
+            return;
+
+        if (length + len > cap)
+            grow(length + len);
+
+        memcpy(ptr() + length, src, len);
+        length += len;
+    }
+
+    template <size_t N>
+    inline bool SmallBuffer<N>::can_read(size_t bytes) const noexcept
+    {
+        return read_ptr <= length && bytes <= length - read_ptr;
+    }
+
+    template <size_t N>
+    inline size_t SmallBuffer<N>::pos() const noexcept
+    {
+        return read_ptr;
+    }
+
+    template <size_t N>
+    inline void SmallBuffer<N>::seek(size_t target) const noexcept
+    {
+        if (target < length) read_ptr = target;
+    }
+
+    //! get a view to the whole buffer, the view has its own read position
+    template <size_t N>
+    inline BufferView SmallBuffer<N>::view() const noexcept
+    {
+        return BufferView(ptr(), length);
+    }
+
+    template <size_t N>
+    inline Buffer SmallBuffer<N>::to_buffer() const
+    {
+        return view().to_buffer();
+    }
+
+    /**
+     * @brief Read data of type T from the buffer
+     *
+     * @param where the position where to read, if omitted, read_ptr is used as the position
+     *
+     * @return Data read as type T, or value-initialised T if there is not enough data
+     */
+    template <size_t N>
+    template <typename T>
+    inline T SmallBuffer<N>::read(size_t where, bool big_endian_mode) const noexcept
+    {
+        if (where == MUSH_DEFAULT_LOC)
+            where = read_ptr;
+
+        if (where > length || length - where < sizeof(T))
+        {
+            assert(0 && "read past the end of a buffer");
+            return T();
+        }
+
+        read_ptr += sizeof(T);
+
+        return detail::load<T>(ptr() + where, big_endian_mode);
+    }
+
+    template <size_t N>
+    template <typename T>
+    inline T SmallBuffer<N>::read_le(size_t where) const noexcept
+    {
+        return read<T>(where, true);
+    }
+
+    template <size_t N>
+    template <typename T>
+    inline bool SmallBuffer<N>::read_array(T* dst, size_t count, bool big_endian_mode) const noexcept
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "read_array requires trivially copyable type");
+
+        if (read_ptr > length || count > (length - read_ptr) / sizeof(T))
+            return false;
+
+        detail::copy_array<T>(reinterpret_cast<uint8_t*>(dst), ptr() + read_ptr, count, big_endian_mode);
+        read_ptr += count * sizeof(T);
+
+        return true;
+    }
+
+    //! read a number written as text, 0 if there is none, see Buffer::read_strval
+    template <size_t N>
+    template <typename T>
+    inline T SmallBuffer<N>::read_strval() const
+    {
+        return read_number<T>().value_or(T());
+    }
+
+    //! parse a number written as text, see Buffer::read_number
+    template <size_t N>
+    template <typename T>
+    inline Result<T> SmallBuffer<N>::read_number() const
+    {
+        if (read_ptr >= length)
+            return Error("end of buffer");
+
+        T value;
+        const uint8_t* start = ptr() + read_ptr;
+        const uint8_t* end = detail::parse_number(start, ptr() + length, value);
+
+        if (end == nullptr)
+            return Error("not a number");
+
+        if (end == start)
+            return Error("out of range");
+
+        read_ptr += end - start;
+        return value;
+    }
+
+    //! take a block of data for unchecked reading, see Buffer::read_block
+    template <size_t N>
+    inline BlockReader SmallBuffer<N>::read_block(size_t bytes) const noexcept
+    {
+        if (read_ptr > length || length - read_ptr < bytes)
+            return BlockReader();
+
+        BlockReader rval(ptr() + read_ptr, bytes);
+        read_ptr += bytes;
+
+        return rval;
+    }
+
+    /**
+     * @brief Write data of type T to the end of the buffer
+     *
+     * @param data  data to be written into the buffer
+     */
+    template <size_t N>
+    template <typename T>
+    inline void SmallBuffer<N>::write(T&& data, bool big_endian_mode)
+    {
+        using value_type = std::decay_t<T>;
+
+        if constexpr(is_byte_range<value_type>::value)
+        {
+            append(data.data(), data.size());
+        }
+        else
+        {
+            static_assert(std::is_trivially_copyable<value_type>::value, "write requires trivially copyable type");
+
+            if (length + sizeof(value_type) > cap)
+                grow(length + sizeof(value_type));
+
+            detail::store<value_type>(ptr() + length, data, big_endian_mode);
+            length += sizeof(value_type);
+        }
+    }
+
+    template <size_t N>
+    template <typename T>
+    inline void SmallBuffer<N>::write_le(T&& data)
+    {
+        write(std::forward<T>(data), true);
+    }
+
+    template <size_t N>
+    template <typename T>
+    inline void SmallBuffer<N>::write_array(const T* src, size_t count, bool big_endian_mode)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "write_array requires trivially copyable type");
+
+        size_t bytes = count * sizeof(T);
+        if (length + bytes > cap)
+            grow(length + bytes);
+
+        detail::copy_array<T>(ptr() + length, reinterpret_cast<const uint8_t*>(src), count, big_endian_mode);
+        length += bytes;
+    }
+
+    template <size_t N>
+    template <typename... Ts>
+    inline void SmallBuffer<N>::write_bytes(Ts... bytes)
+    {
+        const uint8_t values[] = { static_cast<uint8_t>(bytes)... };
+        append(values, sizeof(values));
+    }
+
+    //! read a variable-length integer, false if it cannot be read, see Buffer::read_varint
+    template <size_t N>
+    template <typename T>
+    inline bool SmallBuffer<N>::read_varint(T& value) const noexcept
+    {
+        if (read_ptr >= length)
+            return false;
+
+        uint64_t raw;
+        size_t used = detail::decode_varint(ptr() + read_ptr, length - read_ptr, raw);
+
+        if (used == 0 || !detail::from_varint(raw, value))
+            return false;
+
+        read_ptr += used;
+        return true;
+    }
+
+    //! read a variable-length integer, value-initialised T if it cannot be read
+    template <size_t N>
+    template <typename T>
+    inline T SmallBuffer<N>::read_varint() const noexcept
+    {
+        T rval = T();
+        if (!read_varint(rval))
+            assert(0 && "invalid varint in a buffer");
+
+        return rval;
+    }
+
+    //! write a variable-length integer to the end of the buffer, see Buffer::write_varint
+    template <size_t N>
+    template <typename T>
+    inline void SmallBuffer<N>::write_varint(T value)
+    {
+        uint64_t raw = detail::to_varint(value);
+        size_t bytes = varint_size(raw);
+
+        if (length + bytes > cap)
+            grow(length + bytes);
+
+        detail::encode_varint(ptr() + length, raw);
+        length += bytes;
+    }
+
+    //! read a fixed-layout record described by a Schema, see Buffer::read_record
+    template <size_t N>
+    template <typename Schema>
+    inline bool SmallBuffer<N>::read_record(typename Schema::record_type& record, bool big_endian_mode) const noexcept
+    {
+        if (!can_read(Schema::size))
+            return false;
+
+        Schema::load(ptr() + read_ptr, record, big_endian_mode);
+        read_ptr += Schema::size;
+
+        return true;
+    }
+
+    //! write a fixed-layout record described by a Schema to the end of the buffer
+    template <size_t N>
+    template <typename Schema>
+    inline void SmallBuffer<N>::write_record(const typename Schema::record_type& record, bool big_endian_mode)
+    {
+        if (length + Schema::size > cap)
+            grow(length + Schema::size);
+
+        Schema::store(ptr() + length, record, big_endian_mode);
+        length += Schema::size;
+    }
+}
+
+#endif
+/*
+ Copyright (c) 2017 Jari Ronkainen
+
+    This software is provided 'as-is', without any express or implied warranty.
+    In no event will the authors be held liable for any damages arising from the
+    use of this software.
+
+    Permission is granted to anyone to use this software for any purpose, including
+    commercial applications, and to alter it and redistribute it freely, subject to
+    the following restrictions:
+
+    1. The origin of this software must not be misrepresented; you must not claim
+       that you wrote the original software. If you use this software in a product,
+       an acknowledgment in the product documentation would be appreciated but is
+       not required.
+
+    2. Altered source versions must be plainly marked as such, and must not be
+       misrepresented as being the original software.
+
+    3. This notice may not be removed or altered from any source distribution.
+*/
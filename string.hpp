@@ -12,6 +12,7 @@
 #include <string>
 
 #include "core.hpp"
+#include "hash.hpp"
 
 namespace mush
 {
@@ -221,18 +222,15 @@ namespace mush
             size_t length() const { return data.size(); }
             size_t size() const { return data.size(); }
 
-            /*
-            TODO: Implement this
+            //! Number of bytes the string takes in UTF-8, as written by std_str()
             size_t utf8_length() const
             {
-                size_t len;
-                for (value_type c : *this)
-                {
-                }
+                size_t len = 0;
+                for (char32_t c : data)
+                    len += c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
 
                 return len;
             }
-            */
 
             const char32_t* ptr() const { return &data[0]; }
 
@@ -537,6 +535,23 @@ namespace mush
         return hash;
     };
     
+    namespace hashes
+    {
+        // Hashes the UTF-32 data, FNV-1a gives the same result as String::hash()
+        template<bool is_x86_64, typename Algorithm>
+        class Hash<String, is_x86_64, Algorithm>
+        {
+            public:
+                size_t operator()(const String& s) const noexcept
+                {
+                    if (s.empty())
+                        return hash_bytes<Algorithm>(nullptr, 0);
+
+                    return hash_bytes<Algorithm>(s.ptr(), s.length() * sizeof(char32_t));
+                }
+        };
+    }
+
     #ifndef MUSH_INTERNAL_REMOVE_CR
     #define MUSH_INTERNAL_REMOVE_CR
     template <typename T> struct remove_cr              { typedef T type; };
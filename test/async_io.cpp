@@ -0,0 +1,87 @@
+#include "async_io.hpp"
+
+#include "check.hpp"
+
+using namespace mush;
+
+static Buffer numbered(uint32_t first, uint32_t count)
+{
+    Buffer buffer;
+    for (uint32_t i = first; i < first + count; ++i)
+        buffer.write(i);
+    return buffer;
+}
+
+// adjacent writes, a sync and reads of the same descriptor complete in order, and
+// callbacks run on a worker thread
+static void write_sync_read()
+{
+    char path[] = "/tmp/mush_async_io_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0);
+
+    AsyncIO io(3);
+
+    std::vector<std::future<size_t>> writes;
+    for (uint32_t i = 0; i < 10; ++i)
+        writes.push_back(io.write(fd, i * 400, numbered(i * 100, 100)));
+
+    std::atomic<int> done = 0;
+    std::thread::id caller = std::this_thread::get_id();
+    std::atomic<bool> on_worker = true;
+    io.write(fd, 4000, numbered(1000, 24), [&](size_t written, int error) noexcept {
+        on_worker = on_worker && std::this_thread::get_id() != caller;
+        if (written == 96 && error == 0)
+            ++done;
+    });
+
+    io.sync(fd).get();
+    for (auto& write : writes)
+        CHECK(write.get() == 400);
+    CHECK(done == 1 && on_worker);
+
+    Buffer all = io.read(fd, 0, 8192).get();
+    CHECK(all == numbered(0, 1024));
+
+    std::promise<Buffer> part;
+    io.read(fd, 400, 8, [&](Buffer&& data, int error) noexcept {
+        part.set_value(error == 0 ? std::move(data) : Buffer());
+    });
+    CHECK(part.get_future().get() == numbered(100, 2));
+
+    CHECK(io.read_file(path).get() == all);
+
+    close(fd);
+    unlink(path);
+}
+
+// errors come back as errno values to callbacks and as system_error from futures
+static void errors()
+{
+    AsyncIO io;
+
+    int code = 0;
+    try
+    {
+        io.read(-1, 0, 16).get();
+    }
+    catch (const std::system_error& e)
+    {
+        code = e.code().value();
+    }
+    CHECK(code == EBADF);
+
+    std::promise<int> missing;
+    io.read_file("/nonexistent/mush/file", [&](Buffer&& data, int error) noexcept {
+        missing.set_value(data.empty() ? error : 0);
+    });
+    CHECK(missing.get_future().get() == ENOENT);
+}
+
+int main()
+{
+    write_sync_read();
+    errors();
+
+    return failures;
+}
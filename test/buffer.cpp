@@ -0,0 +1,325 @@
+#include "allocator.hpp"
+#include "buffer.hpp"
+
+#include "check.hpp"
+
+using namespace mush;
+
+static Buffer text(const char* str)
+{
+    Buffer buffer;
+    buffer.write_array(str, strlen(str));
+    return buffer;
+}
+
+// a buffer and a view of the same bytes hash the same, empty ones included
+static void view_hash_matches_buffer()
+{
+    Buffer empty;
+    CHECK(hashes::Hash<Buffer>()(empty) == hashes::Hash<BufferView>()(BufferView(empty)));
+    CHECK(empty.hash() == hashes::Hash<BufferView>()(BufferView()));
+
+    Buffer text;
+    text.write_array("mush", 4);
+    CHECK(hashes::Hash<Buffer>()(text) == hashes::Hash<BufferView>()(BufferView(text)));
+}
+
+// allocator_type and get_allocator() are the allocator the buffer was made with,
+// not the wrapper the storage uses for resize_uninitialized
+static void allocator_type_is_user_allocator()
+{
+    static_assert(std::is_same<Buffer::allocator_type, std::allocator<uint8_t>>::value, "");
+    static_assert(std::is_same<ArenaBuffer::allocator_type, ArenaAllocator<uint8_t>>::value, "");
+
+    MonotonicArena arena;
+    ArenaBuffer buffer(arena);
+    buffer.write_array("arena", 5);
+    CHECK(buffer.get_allocator() == ArenaAllocator<uint8_t>(arena));
+
+    ArenaBuffer part = buffer.copy_bytes(3);
+    CHECK(part.size() == 3 && part.get_allocator() == buffer.get_allocator());
+}
+
+// views keep their own read position, so several can parse the same bytes, and
+// copy_until and copy_bytes return parts of the data instead of copies
+static void view_reads()
+{
+    Buffer buffer;
+    buffer.write_array("key=value;rest", 14);
+
+    BufferView first = buffer.view();
+    BufferView second(buffer);
+
+    BufferView key = first.copy_until('=');
+    CHECK(key.size() == 4 && memcmp(key.data(), "key=", 4) == 0);
+    CHECK(key.data() == buffer.data());
+    CHECK(first.pos() == 4 && second.pos() == 0 && buffer.pos() == 0);
+
+    BufferView value = first.copy_bytes(5);
+    CHECK(value.to_buffer() == text("value"));
+    CHECK(first.copy_bytes(100).empty() && first.pos() == 9);
+
+    CHECK(second.read<uint8_t>() == 'k' && second.remaining() == 13);
+
+    first.skip(100);
+    CHECK(first.remaining() == 0 && !first.can_read(1));
+    CHECK(first.copy_until(';').empty());
+
+    first.seek(10);
+    CHECK(first.copy_until(';').to_buffer() == text("rest"));
+
+    BufferView part = buffer.view().subview(4, 5);
+    CHECK(part.size() == 5 && part[0] == 'v' && part.pos() == 0);
+    CHECK(buffer.view().subview(10).size() == 4);
+    CHECK(buffer.view().subview(20, 3).empty());
+}
+
+// arrays match element by element reads and writes in both byte orders, with counts
+// that leave a tail after the vectorised part of the swap
+template <typename T>
+static void array_round_trip(bool big_endian_mode)
+{
+    T values[37];
+    for (size_t i = 0; i < 37; ++i)
+        values[i] = (T)(0x0102030405060708ull * (i + 1));
+
+    Buffer buffer;
+    buffer.write_array(values, 37, big_endian_mode);
+    CHECK(buffer.size() == sizeof(values));
+
+    Buffer single;
+    for (T value : values)
+        single.write(value, big_endian_mode);
+    CHECK(buffer == single);
+
+    T read[37] = {};
+    CHECK(buffer.read_array(read, 37, big_endian_mode));
+    CHECK(memcmp(read, values, sizeof(values)) == 0);
+    CHECK(!buffer.read_array(read, 1, big_endian_mode));
+
+    BufferView view(buffer);
+    view.skip(sizeof(T));
+    CHECK(!view.read_array(read, 37, big_endian_mode) && view.pos() == sizeof(T));
+    CHECK(view.read_array(read, 36, big_endian_mode));
+    CHECK(memcmp(read, values + 1, sizeof(T) * 36) == 0);
+}
+
+static void arrays()
+{
+    array_round_trip<uint16_t>(false);
+    array_round_trip<uint16_t>(true);
+    array_round_trip<uint32_t>(false);
+    array_round_trip<uint32_t>(true);
+    array_round_trip<uint64_t>(false);
+    array_round_trip<uint64_t>(true);
+
+    const uint32_t value = 0x01020304;
+    Buffer big;
+    big.write_array(&value, 1, true);
+    CHECK(big[0] == 1 && big[1] == 2 && big[2] == 3 && big[3] == 4);
+
+    Buffer little;
+    little.write_array(&value, 1);
+    CHECK(little[0] == 4 && little[1] == 3 && little[2] == 2 && little[3] == 1);
+}
+
+// LEB128 round trips at the size boundaries, zigzag for signed types, and input that
+// is truncated, overlong or out of range for T is refused without moving read_ptr
+static void varints()
+{
+    const uint64_t unsigned_values[] = { 0, 1, 127, 128, 300, 16383, 16384, 1ull << 32, UINT64_MAX };
+    const int64_t signed_values[] = { 0, -1, 1, -64, 64, -65, INT32_MIN, INT64_MIN, INT64_MAX };
+
+    Buffer buffer;
+    for (uint64_t value : unsigned_values)
+        buffer.write_varint(value);
+    for (int64_t value : signed_values)
+        buffer.write_varint(value);
+
+    size_t expected = 0;
+    for (uint64_t value : unsigned_values)
+        expected += varint_size(value);
+    for (int64_t value : signed_values)
+        expected += varint_size(value);
+    CHECK(buffer.size() == expected);
+
+    BufferView view(buffer);
+    for (uint64_t value : unsigned_values)
+        CHECK(buffer.read_varint<uint64_t>() == value && view.read_varint<uint64_t>() == value);
+    for (int64_t value : signed_values)
+        CHECK(buffer.read_varint<int64_t>() == value && view.read_varint<int64_t>() == value);
+    CHECK(!buffer.can_read(1) && view.remaining() == 0);
+
+    Buffer known;
+    known.write_varint(300u);
+    known.write_varint(-1);
+    known.write_varint(-64);
+    CHECK(known == text("\xac\x02\x01\x7f"));
+
+    CHECK(zigzag_encode(0) == 0 && zigzag_encode(-1) == 1 && zigzag_encode(1) == 2 && zigzag_encode(-2) == 3);
+    CHECK(zigzag_encode(INT64_MIN) == UINT64_MAX && zigzag_decode(UINT64_MAX) == INT64_MIN);
+    CHECK(zigzag_decode(zigzag_encode(INT64_MAX)) == INT64_MAX);
+
+    uint64_t value = 0;
+
+    Buffer truncated = text("\x80\x80");
+    CHECK(!truncated.read_varint(value) && truncated.pos() == 0);
+
+    Buffer long_truncated = text("\x80\x80\x80\x80\x80\x80\x80\x80\x80");
+    CHECK(!long_truncated.read_varint(value) && long_truncated.pos() == 0);
+
+    // the tenth byte may only carry the 64th bit
+    Buffer overlong = text("\xff\xff\xff\xff\xff\xff\xff\xff\xff\x02");
+    CHECK(!overlong.read_varint(value) && overlong.pos() == 0);
+
+    Buffer eleven = text("\x80\x80\x80\x80\x80\x80\x80\x80\x80\x80\x01");
+    CHECK(!eleven.read_varint(value));
+    CHECK(!BufferView(eleven).read_varint(value));
+
+    Buffer largest = text("\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01");
+    CHECK(largest.read_varint(value) && value == UINT64_MAX && largest.pos() == 10);
+
+    Buffer wide;
+    wide.write_varint(300u);
+    wide.write_varint((int64_t)-129);
+    uint8_t narrow = 0;
+    int8_t narrow_signed = 0;
+    CHECK(!wide.read_varint(narrow) && wide.pos() == 0);
+    CHECK(wide.read_varint<uint16_t>() == 300);
+    CHECK(!wide.read_varint(narrow_signed) && wide.pos() == 2);
+    CHECK(wide.read_varint<int16_t>() == -129);
+}
+
+static std::vector<Buffer> split(const Buffer& data, uint8_t delim)
+{
+    std::vector<Buffer> rval;
+    for (BufferView record : records(data, delim))
+        rval.push_back(record.to_buffer());
+    return rval;
+}
+
+// records keeps empty records between delimiters but adds none after a trailing one,
+// and find_byte finds the delimiter wherever it is relative to the vectorised blocks
+static void delimiters()
+{
+    std::vector<Buffer> lines = split(text("a\n\nbc\n"), '\n');
+    CHECK(lines.size() == 3 && lines[0] == text("a") && lines[1].empty() && lines[2] == text("bc"));
+
+    lines = split(text("a,bc"), ',');
+    CHECK(lines.size() == 2 && lines[0] == text("a") && lines[1] == text("bc"));
+
+    CHECK(split(Buffer(), '\n').empty());
+    CHECK(split(text("\n"), '\n').size() == 1);
+    CHECK(split(text("no delimiter"), '\n').size() == 1);
+
+    Buffer log = text("first\nsecond");
+    BufferView second = *++records(log).begin();
+    CHECK(second.data() == log.data() + 6 && second.size() == 6);
+
+    uint8_t block[300];
+    memset(block, 'x', sizeof(block));
+    for (size_t at = 0; at < sizeof(block); ++at)
+    {
+        block[at] = ';';
+        CHECK(detail::find_byte(block, sizeof(block), ';') == block + at + 1);
+        CHECK(detail::find_byte(block, at, ';') == block + at);
+        block[at] = 'x';
+    }
+
+    Buffer buffer = text("key;value");
+    CHECK(buffer.copy_until(';') == text("key;") && buffer.pos() == 4);
+    CHECK(buffer.copy_until(';') == text("value") && !buffer.can_read(1));
+    CHECK(buffer.copy_until(';').empty());
+}
+
+// read_number accepts only what from_chars does, and leaves read_ptr alone when it
+// refuses the text, whether there are no digits or the value does not fit
+static void numbers()
+{
+    Buffer list = text("123 -45 6.5e2");
+    auto first = list.read_number<int>();
+    CHECK(first && first.unwrap() == 123 && list.pos() == 3);
+    list.seek(4);
+    auto second = list.read_number<int64_t>();
+    CHECK(second && second.unwrap() == -45 && list.pos() == 7);
+    list.seek(8);
+    auto third = list.read_number<double>();
+    CHECK(third && third.unwrap() == 650.0 && !list.can_read(1));
+    CHECK(!list.read_number<int>());
+
+    Buffer negative = text("-1");
+    CHECK(!negative.read_number<unsigned>() && negative.pos() == 0);
+    CHECK(negative.read_number<int8_t>().value_or(0) == -1);
+
+    CHECK(!text("abc").read_number<int>());
+    CHECK(!text("+5").read_number<int>());
+    CHECK(!text(" 5").read_number<int>());
+    CHECK(!text("-").read_number<int>());
+    CHECK(!Buffer().read_number<int>());
+
+    Buffer wide = text("256");
+    CHECK(!wide.read_number<uint8_t>() && wide.pos() == 0);
+    CHECK(wide.read_number<uint16_t>().value_or(0) == 256 && wide.pos() == 3);
+
+    CHECK(!text("9223372036854775808").read_number<int64_t>());
+    CHECK(text("-9223372036854775808").read_number<int64_t>().value_or(0) == INT64_MIN);
+    CHECK(text("18446744073709551615").read_number<uint64_t>().value_or(0) == UINT64_MAX);
+    CHECK(!text("1e400").read_number<double>());
+
+    CHECK(text("12x").read_strval<int>() == 12);
+    CHECK(text("x12").read_strval<int>() == 0);
+
+    Buffer stored = text("77,8");
+    BufferView view(stored);
+    auto from_view = view.read_number<int>();
+    CHECK(from_view && from_view.unwrap() == 77 && view.pos() == 2 && stored.pos() == 0);
+    CHECK(!view.read_number<int>() && view.pos() == 2);
+}
+
+// read_block checks the whole block once, moves the buffer past it and refuses a
+// block longer than what is left without moving anything
+static void blocks()
+{
+    Buffer buffer;
+    buffer.write((uint32_t)7);
+    buffer.write((uint16_t)0x0102, true);
+    const uint16_t pair[2] = { 3, 4 };
+    buffer.write_array(pair, 2);
+    buffer.write((uint8_t)9);
+
+    BlockReader block = buffer.read_block(10);
+    CHECK(block && block.size() == 10 && buffer.pos() == 10);
+    CHECK(block.read<uint32_t>() == 7);
+    CHECK(block.read<uint16_t>(true) == 0x0102);
+
+    uint16_t read[2] = {};
+    block.read_array(read, 2);
+    CHECK(read[0] == 3 && read[1] == 4 && block.remaining() == 0);
+
+    CHECK(!buffer.read_block(2) && buffer.pos() == 10);
+    BlockReader last = buffer.read_block(1);
+    CHECK(last && *last.getptr() == 9);
+    last.skip(1);
+    CHECK(last.remaining() == 0);
+    CHECK(buffer.read_block(0) && !BlockReader());
+
+    BufferView view(buffer);
+    view.skip(4);
+    BlockReader from_view = view.read_block(2);
+    CHECK(from_view && from_view.read<uint16_t>(true) == 0x0102 && view.pos() == 6);
+    CHECK(!view.read_block(100) && view.pos() == 6);
+}
+
+int main()
+{
+    view_hash_matches_buffer();
+    allocator_type_is_user_allocator();
+    view_reads();
+    arrays();
+    varints();
+    delimiters();
+    numbers();
+    blocks();
+
+    return failures;
+}
@@ -0,0 +1,108 @@
+#include "buffer_chain.hpp"
+
+#include "check.hpp"
+
+using namespace mush;
+
+static Buffer text(const char* str)
+{
+    Buffer buffer;
+    buffer.write_array(str, strlen(str));
+    return buffer;
+}
+
+// owned buffers and views keep their order, prepend goes in front, and consume drops
+// whole segments and then part of the next one
+static void consume_across_segments()
+{
+    const char* shared = "view";
+
+    BufferChain chain;
+    chain.append(text("abc"));
+    chain.append(BufferView((const uint8_t*)shared, 4));
+    chain.append(Buffer());
+    chain.append(text("xyz"));
+    chain.prepend(text("12"));
+
+    CHECK(chain.size() == 12 && chain.segment_count() == 4);
+    CHECK(chain.to_buffer() == text("12abcviewxyz"));
+
+    chain.consume(6);
+    CHECK(chain.size() == 6 && chain.segment_count() == 2);
+    CHECK(chain.begin()->data() == (const uint8_t*)shared + 1);
+    CHECK(chain.to_buffer() == text("iewxyz"));
+
+    chain.consume(3);
+    CHECK(chain.segment_count() == 1 && chain.to_buffer() == text("xyz"));
+
+    chain.consume(100);
+    CHECK(chain.empty() && chain.size() == 0 && chain.segment_count() == 0);
+}
+
+// flatten merges once and keeps the merged buffer, appending a chain moves its segments
+static void flatten_and_join()
+{
+    BufferChain first;
+    first.append(text("one,"));
+
+    BufferChain second;
+    second.append(text("two,"));
+    second.append(text("three"));
+
+    first.append(std::move(second));
+    CHECK(second.empty() && first.segment_count() == 3);
+
+    BufferView flat = first.flatten();
+    CHECK(flat.to_buffer() == text("one,two,three") && first.segment_count() == 1);
+    CHECK(first.flatten().data() == flat.data());
+
+    BufferChain empty;
+    CHECK(empty.flatten().empty() && empty.to_buffer().empty());
+}
+
+#ifdef MUSH_BUFFER_CHAIN_IOVEC
+// more segments than one writev batch, all of it arrives in order and the chain
+// is left empty
+static void write_to_pipe()
+{
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+
+    BufferChain chain;
+    Buffer expected;
+    for (int i = 0; i < 200; ++i)
+    {
+        Buffer segment;
+        segment.write((uint32_t)i);
+        expected.write((uint32_t)i);
+        chain.append(std::move(segment));
+    }
+
+    CHECK(chain.iovecs().size() == 200);
+    CHECK(chain.write_to(fds[1]));
+    CHECK(chain.empty());
+    close(fds[1]);
+
+    Buffer received;
+    received.resize(expected.size() + 1);
+    size_t got = 0;
+    ssize_t n;
+    while ((n = read(fds[0], received.data() + got, received.size() - got)) > 0)
+        got += n;
+    close(fds[0]);
+
+    received.resize(got);
+    CHECK(received == expected);
+}
+#endif
+
+int main()
+{
+    consume_across_segments();
+    flatten_and_join();
+    #ifdef MUSH_BUFFER_CHAIN_IOVEC
+    write_to_pipe();
+    #endif
+
+    return failures;
+}
@@ -0,0 +1,81 @@
+#include "buffer_pool.hpp"
+
+#include <thread>
+
+#include "check.hpp"
+
+using namespace mush;
+
+// a released buffer comes back empty with its memory, rounded up to its size class
+static void reuse()
+{
+    BufferPool pool;
+
+    Buffer first = pool.acquire(1000);
+    CHECK(first.capacity() >= 1024 && pool.stats().misses == 1);
+    first.write_array("data", 4);
+    const uint8_t* memory = first.data();
+    pool.release(std::move(first));
+
+    Buffer second = pool.acquire(700);
+    CHECK(second.data() == memory && second.empty() && second.pos() == 0);
+    CHECK(pool.stats().hits == 1 && pool.stats().misses == 1);
+
+    // too large to pool, and too small to keep
+    Buffer huge = pool.acquire(BufferPool::MAX_CAPACITY + 1);
+    CHECK(huge.capacity() > BufferPool::MAX_CAPACITY && pool.stats().misses == 2);
+
+    Buffer tiny;
+    tiny.reserve(16);
+    pool.release(std::move(tiny));
+    pool.reset_stats();
+    pool.acquire(16);
+    CHECK(pool.stats().hits == 0 && pool.stats().misses == 1);
+}
+
+// a full thread cache spills half to the shared lists, and the rest is handed back
+// when the thread exits, so another thread gets all of them
+static void thread_caches()
+{
+    BufferPool pool(64, 4);
+
+    std::thread producer([&pool] {
+        std::vector<Buffer> buffers;
+        for (int i = 0; i < 6; ++i)
+            buffers.push_back(pool.acquire(300));
+        for (Buffer& buffer : buffers)
+            pool.release(std::move(buffer));
+    });
+    producer.join();
+    CHECK(pool.stats().misses == 6);
+
+    pool.reset_stats();
+    std::thread consumer([&pool] {
+        std::vector<Buffer> buffers;
+        for (int i = 0; i < 7; ++i)
+            buffers.push_back(pool.acquire(300));
+    });
+    consumer.join();
+    CHECK(pool.stats().hits == 6 && pool.stats().misses == 1);
+}
+
+// a new pool does not get the buffers cached for a destroyed one, even if its shared
+// part is allocated at the same address
+static void stale_cache()
+{
+    for (int i = 0; i < 4; ++i)
+    {
+        BufferPool pool;
+        CHECK(pool.acquire(500).capacity() >= 512 && pool.stats().misses == 1);
+        pool.release(pool.acquire(500));
+    }
+}
+
+int main()
+{
+    reuse();
+    thread_caches();
+    stale_cache();
+
+    return failures;
+}
@@ -0,0 +1,17 @@
+#ifndef MUSH_TEST_CHECK
+#define MUSH_TEST_CHECK
+
+#include <cstdio>
+
+// Keeps going after a failed check so one run shows every failure, main returns failures
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            ++failures; \
+        } \
+    } while (0)
+
+#endif
@@ -0,0 +1,91 @@
+#include "chunk_reader.hpp"
+
+#include "check.hpp"
+
+using namespace mush;
+
+static const char* path = "/tmp/mush_chunk_reader_test";
+
+static void write_file(const Buffer& data)
+{
+    FILE* file = fopen(path, "wb");
+    CHECK(file != nullptr);
+    fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+}
+
+// chunks smaller than the values read, so nearly every value is split between two
+static void reads_across_chunks()
+{
+    Buffer data;
+    for (uint32_t i = 0; i < 3000; ++i)
+        data.write(i);
+    data.write_array("first line\nsecond line\ntail", 27);
+    write_file(data);
+
+    ChunkReader reader(path, 3, 2);
+    CHECK(reader && !reader.failed());
+
+    bool in_order = true;
+    for (uint32_t i = 0; i < 3000; ++i)
+        in_order = in_order && reader.read<uint32_t>() == i;
+    CHECK(in_order && reader.pos() == 12000);
+
+    Buffer first = reader.copy_until('\n');
+    CHECK(first.size() == 11 && memcmp(first.data(), "first line\n", 11) == 0);
+    Buffer second = reader.copy_bytes(12);
+    CHECK(second.size() == 12 && memcmp(second.data(), "second line\n", 12) == 0);
+    Buffer tail = reader.copy_until('\n');
+    CHECK(tail.size() == 4 && memcmp(tail.data(), "tail", 4) == 0);
+
+    CHECK(reader.eof() && reader.pos() == data.size());
+    CHECK(reader.read<uint32_t>() == 0);
+    CHECK(reader.copy_bytes(10).empty());
+}
+
+// taking whole chunks gives the file back in order, the partly read one included
+static void whole_chunks()
+{
+    Buffer data;
+    for (int i = 0; i < 10000; ++i)
+        data.write((uint8_t)(i * 7));
+    write_file(data);
+
+    ChunkReader reader(path, 1024);
+    uint8_t head[10];
+    CHECK(reader.read_bytes(head, 10) == 10 && memcmp(head, data.data(), 10) == 0);
+    CHECK(reader.skip(5) == 5);
+
+    Buffer joined;
+    joined.write_array(data.data(), 15);
+    size_t chunks = 0;
+    for (Buffer chunk = reader.next_chunk(); !chunk.empty(); chunk = reader.next_chunk())
+    {
+        CHECK(chunk.size() <= 1024);
+        joined.write_array(chunk.data(), chunk.size());
+        reader.recycle(std::move(chunk));
+        ++chunks;
+    }
+    CHECK(joined == data && chunks == 10);
+    CHECK(reader.skip(1) == 0 && reader.eof());
+
+    std::remove(path);
+}
+
+static void missing_file()
+{
+    ChunkReader reader("/nonexistent/mush/file");
+    CHECK(!reader && !reader.is_open() && reader.eof());
+
+    uint8_t byte;
+    CHECK(reader.read_bytes(&byte, 1) == 0);
+}
+
+int main()
+{
+    reads_across_chunks();
+    whole_chunks();
+    missing_file();
+
+    return failures;
+}
@@ -0,0 +1,279 @@
+#define MUSH_IMPLEMENT_COMPRESSION
+#include "compression.hpp"
+#include "compression_parallel.hpp"
+#include "compression_pool.hpp"
+
+#include "check.hpp"
+
+using namespace mush;
+
+// a back reference split between the dictionary and the output, with 1 byte left over
+// for the output part, must not write past an exactly sized buffer
+static void dictionary_split_reference()
+{
+    const uint8_t stream[] = { 6, 'A', 'B', 'C', 'D', 'E', 'F', 'G', 0x20, 8 };
+    const char* text = "0123456789abcdef";
+    lzf::Dictionary dictionary((const uint8_t*)text, 16);
+
+    uint8_t* out = new uint8_t[10];
+    size_t size = lzf::decompress_into(stream, sizeof(stream), out, 10, dictionary);
+
+    CHECK(size == 10);
+    CHECK(memcmp(out, "ABCDEFGefA", 10) == 0);
+
+    delete[] out;
+}
+
+static Buffer framed_bytes(uint32_t unpacked_size, uint8_t flag, const char* data, size_t size)
+{
+    Buffer buffer;
+    buffer.write(unpacked_size);
+    buffer.write(flag);
+    buffer.write_array(data, size);
+
+    return buffer;
+}
+
+// whatever the room given, the encoder must not write past it, even when the
+// literals left at the end of the input start exactly at the limit
+static void compress_bounds()
+{
+    Buffer input;
+    for (int i = 0; i < 1000; ++i)
+        input.write((uint8_t)(i % 251));
+
+    for (lzf::Level level : { lzf::Level::fast, lzf::Level::high })
+    {
+        for (size_t maxout = 2; maxout < input.size() + 64; ++maxout)
+        {
+            std::vector<uint8_t> out(input.size() + 128, 0xaa);
+            lzf::compress_into(input.data(), input.size(), out.data(), maxout, level);
+
+            size_t dirty = maxout;
+            while (dirty < out.size() && out[dirty] == 0xaa)
+                ++dirty;
+            CHECK(dirty == out.size());
+        }
+    }
+}
+
+// headers that do not match the data must fail cleanly, not return uninitialized bytes
+static void corrupt_headers()
+{
+    Buffer output;
+    output.write_array("stale", 5);
+
+    // stored data shorter than the header claims
+    CHECK(!lzf::uncompress(framed_bytes(100, 0, "0123456789", 10), output));
+    CHECK(output.size() == 0);
+
+    // compressed size that no stream this short can decode to, rejected before allocating
+    CHECK(!lzf::uncompress(framed_bytes(0xffffffff, 1, "\x02" "abc", 4), output));
+    CHECK(output.size() == 0);
+
+    // stream decodes to fewer bytes than the header claims
+    CHECK(!lzf::uncompress(framed_bytes(10, 1, "\x02" "abc", 4), output));
+    CHECK(output.size() == 0);
+
+    CHECK(!lzf::uncompress(framed_bytes(3, 7, "abc", 3), output));
+    CHECK(lzf::uncompress(framed_bytes(3, 1, "\x02" "abc", 4), output));
+    CHECK(output.size() == 3 && memcmp(output.data(), "abc", 3) == 0);
+
+    CHECK(lzf::uncompress(framed_bytes(10, 0, "abc", 3)).size() == 0);
+}
+
+// the dictionary variant checks its header the same way, before allocating anything
+static void dictionary_corrupt_headers()
+{
+    const char* text = "0123456789abcdef";
+    lzf::Dictionary dictionary((const uint8_t*)text, 16);
+
+    CHECK(!lzf::uncompress(framed_bytes(0xffffffff, 0, "", 0), dictionary));
+    CHECK(!lzf::uncompress(framed_bytes(0xffffffff, 1, "\x02" "abc", 4), dictionary));
+    CHECK(!lzf::uncompress(framed_bytes(3, 2, "abc", 3), dictionary));
+
+    Buffer truncated;
+    truncated.write_array("\x03\x00", 2);
+    CHECK(!lzf::uncompress(truncated, dictionary));
+
+    auto empty = lzf::uncompress(Buffer(), dictionary);
+    CHECK(empty && empty.unwrap().size() == 0);
+
+    auto stored = lzf::uncompress(framed_bytes(3, 0, "abc", 3), dictionary);
+    CHECK(stored && stored.unwrap().size() == 3);
+
+    Buffer input;
+    input.write_array("0123456789abcdef0123", 20);
+    auto output = lzf::uncompress(lzf::compress(input, dictionary), dictionary);
+    CHECK(output && output.unwrap() == input);
+}
+
+// the pooled output must have room for the decoder's fast path, not just the raw size
+static void pool_capacity()
+{
+    Buffer input;
+    for (int i = 0; i < 1000; ++i)
+        input.write((uint8_t)(i % 7));
+
+    BufferPool pool;
+    Buffer output = lzf::uncompress(lzf::compress(input), pool);
+
+    CHECK(output.size() == input.size() && memcmp(output.data(), input.data(), input.size()) == 0);
+    CHECK(output.capacity() >= lzf::decompress_bound(input.size()));
+
+    pool.release(std::move(output));
+}
+
+// a block claiming far more data than its stored bytes can hold is rejected before
+// the output is allocated
+static void framed_ratio()
+{
+    Buffer frame;
+    frame.write_array(lzf::FRAME_MAGIC, 4);
+    frame.write(lzf::FRAME_VERSION);
+    frame.write(lzf::BLOCK_LZF);
+    frame.write((uint32_t)lzf::MAX_BLOCK_SIZE);
+    frame.write((uint32_t)4);
+    frame.write_array("\x02" "abc", 4);
+    frame.write(lzf::BLOCK_END);
+    frame.write((uint64_t)lzf::MAX_BLOCK_SIZE);
+
+    thread_pool pool(2);
+    CHECK(!lzf::uncompress_parallel(frame, pool));
+    CHECK(!lzf::uncompress_framed(frame));
+
+    Buffer input;
+    for (int i = 0; i < 100000; ++i)
+        input.write((uint8_t)((uint32_t)i * i >> 5));
+
+    auto output = lzf::uncompress_parallel(lzf::compress_parallel(input, pool, 4096), pool);
+    CHECK(output && output.unwrap() == input);
+}
+
+// a block size of 0 is clamped to 1, as by the Compressor
+static void framed_zero_block()
+{
+    Buffer input;
+    input.write_array("framed", 6);
+
+    auto output = lzf::uncompress_framed(lzf::compress_framed(input, 0));
+    CHECK(output && output.unwrap() == input);
+}
+
+// round trips through the block codec and the Codec interface, into output that is
+// exactly the raw size, with inputs short enough to be only literals and long enough
+// for matches farther back than MAX_DISTANCE
+static void lz4_round_trip()
+{
+    std::vector<Buffer> inputs;
+    for (size_t size : { 1, 5, 12, 13, 20, 300 })
+    {
+        Buffer input;
+        for (size_t i = 0; i < size; ++i)
+            input.write((uint8_t)('a' + i % 3));
+        inputs.push_back(input);
+    }
+
+    Buffer text;
+    for (int i = 0; i < 2000; ++i)
+        text.write_array("the quick brown fox ", 20);
+    inputs.push_back(text);
+
+    Buffer far;
+    uint32_t x = 1;
+    for (int i = 0; i < 70000; ++i)
+    {
+        x = x * 1103515245 + 12345;
+        far.write((uint8_t)(x >> 16));
+    }
+    far.insert(far.end(), far.begin(), far.begin() + 5000);
+    inputs.push_back(far);
+
+    for (const Buffer& input : inputs)
+    {
+        std::vector<uint8_t> packed(lz4::compress_bound(input.size()));
+        size_t size = lz4::compress_into(input.data(), input.size(), packed.data(), packed.size());
+        CHECK(size != 0);
+
+        uint8_t* exact = new uint8_t[input.size()];
+        CHECK(lz4::decompress_into(packed.data(), size, exact, input.size()) == input.size());
+        CHECK(memcmp(exact, input.data(), input.size()) == 0);
+        delete[] exact;
+
+        Buffer compressed, output;
+        compress(LZ4Codec(), input, compressed);
+        CHECK(decompress(*find_codec("lz4"), compressed, output, input.size()));
+        CHECK(output == input);
+    }
+
+    Buffer packed_text;
+    compress(LZ4Codec(), text, packed_text);
+    CHECK(packed_text.size() != 0 && packed_text.size() < text.size() / 20);
+}
+
+// a block written by hand in the reference format: four literals, a match of eight
+// bytes four bytes back, and the closing literals
+static void lz4_known_block()
+{
+    const uint8_t block[] = { 0x44, 'a', 'b', 'c', 'd', 4, 0, 0x50, '1', '2', '3', '4', '5' };
+
+    uint8_t out[17];
+    CHECK(lz4::decompress_into(block, sizeof(block), out, sizeof(out)) == 17);
+    CHECK(memcmp(out, "abcdabcdabcd12345", 17) == 0);
+}
+
+// corrupt blocks fail without reading or writing out of bounds
+static void lz4_corrupt()
+{
+    uint8_t* out = new uint8_t[17];
+
+    const uint8_t zero_distance[] = { 0x44, 'a', 'b', 'c', 'd', 0, 0, 0x50, '1', '2', '3', '4', '5' };
+    const uint8_t far_distance[] = { 0x44, 'a', 'b', 'c', 'd', 5, 0, 0x50, '1', '2', '3', '4', '5' };
+    const uint8_t ends_in_match[] = { 0x44, 'a', 'b', 'c', 'd', 4, 0 };
+    const uint8_t long_literals[] = { 0x90, 'a', 'b', 'c' };
+    const uint8_t open_length[] = { 0xf0, 255, 255 };
+
+    CHECK(lz4::decompress_into(zero_distance, sizeof(zero_distance), out, 17) == 0);
+    CHECK(lz4::decompress_into(far_distance, sizeof(far_distance), out, 17) == 0);
+    CHECK(lz4::decompress_into(ends_in_match, sizeof(ends_in_match), out, 17) == 0);
+    CHECK(lz4::decompress_into(long_literals, sizeof(long_literals), out, 17) == 0);
+    CHECK(lz4::decompress_into(open_length, sizeof(open_length), out, 17) == 0);
+
+    const uint8_t valid[] = { 0x44, 'a', 'b', 'c', 'd', 4, 0, 0x50, '1', '2', '3', '4', '5' };
+    CHECK(lz4::decompress_into(valid, sizeof(valid), out, 16) == 0);
+    CHECK(lz4::decompress_into(valid, sizeof(valid) - 1, out, 17) == 0);
+    delete[] out;
+
+    Buffer input;
+    for (int i = 0; i < 3000; ++i)
+        input.write((uint8_t)("lz4 block "[i % 10] + i / 700));
+
+    std::vector<uint8_t> packed(lz4::compress_bound(input.size()));
+    size_t size = lz4::compress_into(input.data(), input.size(), packed.data(), packed.size());
+
+    for (size_t at = 0; at < size; at += 7)
+    {
+        std::vector<uint8_t> damaged(packed.begin(), packed.begin() + size);
+        damaged[at] ^= 0x5a;
+
+        uint8_t* exact = new uint8_t[input.size()];
+        CHECK(lz4::decompress_into(damaged.data(), damaged.size(), exact, input.size()) <= input.size());
+        delete[] exact;
+    }
+}
+
+int main()
+{
+    dictionary_split_reference();
+    compress_bounds();
+    corrupt_headers();
+    dictionary_corrupt_headers();
+    pool_capacity();
+    framed_ratio();
+    framed_zero_block();
+    lz4_round_trip();
+    lz4_known_block();
+    lz4_corrupt();
+
+    return failures;
+}
@@ -0,0 +1,74 @@
+#include "mapped_buffer.hpp"
+
+#include "check.hpp"
+
+using namespace mush;
+
+static void write_file(const char* path, const Buffer& data)
+{
+    FILE* file = fopen(path, "wb");
+    CHECK(file != nullptr);
+    if (!data.empty())
+        fwrite(data.data(), 1, data.size(), file);
+    fclose(file);
+}
+
+// the mapping holds the same bytes file_to_buffer reads and is read like any view
+static void matches_file_to_buffer()
+{
+    const char* path = "/tmp/mush_mapped_buffer_test";
+
+    Buffer data;
+    for (uint32_t i = 0; i < 5000; ++i)
+        data.write(i);
+    write_file(path, data);
+
+    MappedBuffer mapped(path);
+    CHECK(mapped && mapped.is_open());
+    CHECK(mapped.size() == data.size());
+    CHECK(mapped.to_buffer() == file_to_buffer(path));
+
+    mapped.seek(400);
+    CHECK(mapped.read<uint32_t>() == 100 && mapped.pos() == 404);
+
+    CHECK(mapped.advise(access_pattern::random));
+    CHECK(mapped.advise(5000, 100, access_pattern::will_need));
+    CHECK(!mapped.advise(data.size(), 1, access_pattern::normal));
+
+    // moving hands over the mapping, the moved-from buffer is closed and empty
+    MappedBuffer moved(std::move(mapped));
+    CHECK(!mapped && mapped.empty());
+    CHECK(moved && moved.read<uint32_t>(8) == 2);
+
+    MappedBuffer assigned;
+    assigned = std::move(moved);
+    CHECK(!moved && assigned.size() == data.size());
+
+    assigned.close();
+    CHECK(!assigned && assigned.empty());
+
+    unlink(path);
+}
+
+// an empty file opens to an empty view, a missing one does not open
+static void empty_and_missing()
+{
+    const char* path = "/tmp/mush_mapped_buffer_empty";
+    write_file(path, Buffer());
+
+    MappedBuffer empty(path);
+    CHECK(empty && empty.size() == 0);
+    CHECK(!empty.advise(access_pattern::sequential));
+    unlink(path);
+
+    MappedBuffer missing;
+    CHECK(!missing.open("/nonexistent/mush/file") && !missing && missing.empty());
+}
+
+int main()
+{
+    matches_file_to_buffer();
+    empty_and_missing();
+
+    return failures;
+}
@@ -0,0 +1,58 @@
+#include "monadic_error.hpp"
+
+#include "check.hpp"
+
+using namespace mush;
+
+static int live = 0;
+
+struct Counted
+{
+    Counted()                   { ++live; }
+    Counted(const Counted&)     { ++live; }
+    Counted(Counted&&)          { ++live; }
+   ~Counted()                   { --live; }
+};
+
+static Result<Counted> make(bool good)
+{
+    if (good)
+        return Counted();
+
+    return Error("no value");
+}
+
+// values and errors are destroyed with the result, unwrapped or not
+static void result_cleanup()
+{
+    {
+        Result<Counted> r = make(true);
+    }
+    CHECK(live == 0);
+
+    {
+        Result<Counted> r = make(true);
+        Counted value = r.unwrap();
+    }
+    CHECK(live == 0);
+
+    {
+        Result<Counted> r = make(false);
+        CHECK(!r);
+    }
+    CHECK(live == 0);
+
+    {
+        Result<Counted> r = Error("first");
+        r = Counted();
+        r = Error("second");
+    }
+    CHECK(live == 0);
+}
+
+int main()
+{
+    result_cleanup();
+
+    return failures;
+}
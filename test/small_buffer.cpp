@@ -0,0 +1,37 @@
+#include "small_buffer.hpp"
+
+#include "check.hpp"
+
+using namespace mush;
+
+// the reads SmallBuffer shares with Buffer give the same results on the same bytes
+static void same_reads_as_buffer()
+{
+    SmallBuffer<16> small;
+    Buffer buffer;
+
+    small.write_array("42 7", 4);
+    buffer.write_array("42 7", 4);
+
+    auto a = small.read_number<int>();
+    auto b = buffer.read_number<int>();
+    CHECK(a && b && a.unwrap() == b.unwrap());
+    CHECK(small.pos() == buffer.pos());
+
+    small.seek(3);
+    CHECK(small.read_strval<int>() == 7);
+
+    small.write<uint32_t>(0x01020304);
+    small.seek(4);
+
+    BlockReader block = small.read_block(4);
+    CHECK(block && block.read<uint32_t>() == 0x01020304);
+    CHECK(!small.read_block(1));
+}
+
+int main()
+{
+    same_reads_as_buffer();
+
+    return failures;
+}
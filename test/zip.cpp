@@ -0,0 +1,114 @@
+#include "zip.hpp"
+
+#include "check.hpp"
+
+using namespace mush;
+
+// an archive with one stored file, its central directory written and read back
+static void central_directory_round_trip()
+{
+    const char* text = "hello zip";
+
+    zip::LocalFileHeader local = {};
+    local.local_file_header_signature = 0x04034b50;
+    local.version_needed_to_extract = 10;
+    local.compressed_size = 9;
+    local.uncompressed_size = 9;
+    local.filename_length = 5;
+
+    Buffer archive;
+    archive.write_record<zip::LocalFileHeaderSchema>(local);
+    archive.write_array("a.txt", 5);
+    archive.write_array(text, 9);
+
+    zip::CentralFileHeader entry = {};
+    entry.version_made_by = 20;
+    entry.version_needed_to_extract = 10;
+    entry.compressed_size = 9;
+    entry.uncompressed_size = 9;
+    entry.file_name = "a.txt";
+    entry.file_comment.write_array("note", 4);
+
+    CHECK(zip::write_central_directory({ entry }, archive));
+
+    zip::EndOfCentralDirectory end;
+    std::vector<zip::CentralFileHeader> entries;
+
+    CHECK(zip::read_central_directory(archive, end, entries));
+    CHECK(end.total_number_of_entries == 1);
+    CHECK(end.offset_to_disk_number == zip::LocalFileHeaderSchema::size + 5 + 9);
+    CHECK(entries.size() == 1);
+    CHECK(entries[0].file_name == "a.txt");
+    CHECK(entries[0].file_name_length == 5);
+    CHECK(entries[0].file_comment.size() == 4);
+    CHECK(entries[0].uncompressed_size == 9 && entries[0].relative_offset_of_local_header == 0);
+
+    // archive comment after the end record is skipped over when searching for it
+    archive[archive.size() - 2] = 3;
+    archive.write_array("xyz", 3);
+    CHECK(zip::read_central_directory(archive, end, entries));
+    CHECK(end.zip_file_comment.size() == 3 && entries.size() == 1);
+
+    archive.resize(archive.size() - 1);
+    CHECK(!zip::read_central_directory(archive, end, entries));
+    CHECK(entries.empty());
+}
+
+// names are written as UTF-8 and their length counted in bytes
+static void utf8_names()
+{
+    zip::CentralFileHeader entry = {};
+    entry.file_name = "p\u00e4iv\u00e4.txt";
+
+    Buffer archive;
+    CHECK(zip::write_central_directory({ entry }, archive));
+
+    zip::EndOfCentralDirectory end;
+    std::vector<zip::CentralFileHeader> entries;
+    CHECK(zip::read_central_directory(archive, end, entries));
+    CHECK(entries.size() == 1 && entries[0].file_name_length == 11);
+    CHECK(entries[0].file_name == "p\u00e4iv\u00e4.txt");
+}
+
+// lengths and counts that do not fit their 16-bit fields need zip64, nothing is written
+static void limits()
+{
+    Buffer archive;
+    archive.write_array("data", 4);
+
+    zip::CentralFileHeader entry = {};
+    entry.file_name = "a";
+    entry.file_comment.resize(0x10000);
+    CHECK(!zip::write_central_directory({ entry }, archive));
+    CHECK(archive.size() == 4);
+
+    entry.file_comment.resize(0xffff);
+    entry.extra_field.resize(0x10000);
+    CHECK(!zip::write_central_directory({ entry }, archive));
+
+    entry.extra_field.clear();
+    entry.file_comment.clear();
+    entry.file_name = std::string(0x10000, 'n');
+    CHECK(!zip::write_central_directory({ entry }, archive));
+    CHECK(archive.size() == 4);
+
+    entry.file_name = "a";
+    std::vector<zip::CentralFileHeader> many(0xffff, entry);
+    CHECK(!zip::write_central_directory(many, archive));
+    many.pop_back();
+    CHECK(zip::write_central_directory(many, archive));
+
+    zip::EndOfCentralDirectory end;
+    std::vector<zip::CentralFileHeader> entries;
+    CHECK(zip::read_central_directory(archive, end, entries));
+    CHECK(end.total_number_of_entries == 0xfffe && entries.size() == 0xfffe);
+}
+
+int main()
+{
+    central_directory_round_trip();
+    utf8_names();
+    limits();
+
+    return failures;
+}
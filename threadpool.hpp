@@ -54,7 +54,7 @@ namespace mush
 
                     {
                         std::unique_lock<std::mutex> lock(queue_mutex);
-                        condition.wait(lock, [&]{return end || tasks.empty(); });
+                        condition.wait(lock, [&]{return end || !tasks.empty(); });
 
                         if (end && tasks.empty())
                             return;
@@ -98,7 +98,7 @@ namespace mush
     {
         using return_type = typename std::result_of<Function(Args...)>::type;
 
-        auto task = std::make_shared<std::packaged_task<return_type>>(
+        auto task = std::make_shared<std::packaged_task<return_type()>>(
                         std::bind(std::forward<Function>(f), std::forward<Args>(args)...)
                     );
 
@@ -1,6 +1,12 @@
+#ifndef MUSH_ZIP
+#define MUSH_ZIP
+
+#include <vector>
+
 #include "buffer.hpp"
 #include "string.hpp"
 #include "checksum.hpp"
+#include "schema.hpp"
 
 namespace mush
 {
@@ -51,6 +57,20 @@ namespace mush
             Buffer      extra_field;
         };
 
+        // Schemas describe the fixed-size part of each record, the variable-length
+        // fields following it are read separately.  ZIP is little-endian throughout.
+        using LocalFileHeaderSchema = Schema<&LocalFileHeader::local_file_header_signature,
+                                             &LocalFileHeader::version_needed_to_extract,
+                                             &LocalFileHeader::general_purpose_bit_flag,
+                                             &LocalFileHeader::compression_method,
+                                             &LocalFileHeader::last_mod_file_time,
+                                             &LocalFileHeader::last_mod_file_date,
+                                             &LocalFileHeader::crc32,
+                                             &LocalFileHeader::compressed_size,
+                                             &LocalFileHeader::uncompressed_size,
+                                             &LocalFileHeader::filename_length,
+                                             &LocalFileHeader::extra_field_length>;
+
         struct DataDescriptor
         {
             uint32_t    crc32;
@@ -58,12 +78,19 @@ namespace mush
             uint32_t    uncompressed_size;
         };
 
+        using DataDescriptorSchema = Schema<&DataDescriptor::crc32,
+                                            &DataDescriptor::compressed_size,
+                                            &DataDescriptor::uncompressed_size>;
+
         struct ArchiveExtraData
         {
             uint32_t    archive_extra_data_signature;   // (0x08064b50)
             uint32_t    extra_field_length;
             Buffer      extra_field_data;
         };
+
+        using ArchiveExtraDataSchema = Schema<&ArchiveExtraData::archive_extra_data_signature,
+                                              &ArchiveExtraData::extra_field_length>;
         /*
         4.3.12  Central directory structure:
 
@@ -113,6 +140,7 @@ namespace mush
             uint32_t    uncompressed_size;
             uint16_t    file_name_length;
             uint16_t    extra_field_length;
+            uint16_t    file_comment_length;
             uint16_t    disk_number_start;
             uint16_t    internal_file_attributes;
             uint32_t    external_file_attributes;
@@ -123,6 +151,24 @@ namespace mush
             Buffer      file_comment;
         };
 
+        using CentralFileHeaderSchema = Schema<&CentralFileHeader::central_file_header_signature,
+                                               &CentralFileHeader::version_made_by,
+                                               &CentralFileHeader::version_needed_to_extract,
+                                               &CentralFileHeader::general_purpose_bit_flag,
+                                               &CentralFileHeader::compression_method,
+                                               &CentralFileHeader::last_mod_file_time,
+                                               &CentralFileHeader::last_mod_file_date,
+                                               &CentralFileHeader::crc32,
+                                               &CentralFileHeader::compressed_size,
+                                               &CentralFileHeader::uncompressed_size,
+                                               &CentralFileHeader::file_name_length,
+                                               &CentralFileHeader::extra_field_length,
+                                               &CentralFileHeader::file_comment_length,
+                                               &CentralFileHeader::disk_number_start,
+                                               &CentralFileHeader::internal_file_attributes,
+                                               &CentralFileHeader::external_file_attributes,
+                                               &CentralFileHeader::relative_offset_of_local_header>;
+
         struct DigitalSignature
         {
             uint32_t    header_signature; // (0x05054b50)
@@ -130,6 +176,9 @@ namespace mush
             Buffer      signature_data;
         };
 
+        using DigitalSignatureSchema = Schema<&DigitalSignature::header_signature,
+                                              &DigitalSignature::size_of_data>;
+
         struct Zip64ExtensibleDataBlock
         {
             uint16_t    header_id;
@@ -138,6 +187,9 @@ namespace mush
             Buffer      data;
         };
 
+        using Zip64ExtensibleDataBlockSchema = Schema<&Zip64ExtensibleDataBlock::header_id,
+                                                      &Zip64ExtensibleDataBlock::data_size>;
+
         struct Zip64EndOfCentralDirectory
         {
             uint32_t    signature; // (0x06065b50)
@@ -154,6 +206,17 @@ namespace mush
             std::vector<Zip64ExtensibleDataBlock> extensible_data_sector;
         };
 
+        using Zip64EndOfCentralDirectorySchema = Schema<&Zip64EndOfCentralDirectory::signature,
+                                                        &Zip64EndOfCentralDirectory::size_of_record,
+                                                        &Zip64EndOfCentralDirectory::version_made_by,
+                                                        &Zip64EndOfCentralDirectory::version_needed_to_extract,
+                                                        &Zip64EndOfCentralDirectory::number_of_this_disk,
+                                                        &Zip64EndOfCentralDirectory::central_directory_start_disk,
+                                                        &Zip64EndOfCentralDirectory::total_number_of_entries_this_disk,
+                                                        &Zip64EndOfCentralDirectory::total_number_of_entries,
+                                                        &Zip64EndOfCentralDirectory::size_of_central_directory,
+                                                        &Zip64EndOfCentralDirectory::offset_to_disk_number>;
+
         struct Zip64EndOfCentralDirectoryLocator
         {
             uint32_t    signature; // (0x07054b50)
@@ -162,9 +225,14 @@ namespace mush
             uint32_t    total_number_of_disks;
         };
 
+        using Zip64EndOfCentralDirectoryLocatorSchema = Schema<&Zip64EndOfCentralDirectoryLocator::signature,
+                                                               &Zip64EndOfCentralDirectoryLocator::central_directory_end_start_disk,
+                                                               &Zip64EndOfCentralDirectoryLocator::relative_offset,
+                                                               &Zip64EndOfCentralDirectoryLocator::total_number_of_disks>;
+
         struct EndOfCentralDirectory
         {
-            uint32_t    signature; // (0x0605b450)
+            uint32_t    signature; // (0x06054b50)
             uint16_t    number_of_this_disk;
             uint16_t    central_directory_start_disk;
             uint16_t    total_number_of_entries_this_disk;
@@ -175,9 +243,173 @@ namespace mush
 
             Buffer      zip_file_comment;
         };
+
+        using EndOfCentralDirectorySchema = Schema<&EndOfCentralDirectory::signature,
+                                                   &EndOfCentralDirectory::number_of_this_disk,
+                                                   &EndOfCentralDirectory::central_directory_start_disk,
+                                                   &EndOfCentralDirectory::total_number_of_entries_this_disk,
+                                                   &EndOfCentralDirectory::total_number_of_entries,
+                                                   &EndOfCentralDirectory::size_of_central_directory,
+                                                   &EndOfCentralDirectory::offset_to_disk_number,
+                                                   &EndOfCentralDirectory::zip_file_comment_length>;
+
+        constexpr uint32_t  CENTRAL_FILE_HEADER_SIGNATURE = 0x02014b50;
+        constexpr uint32_t  END_OF_CENTRAL_DIRECTORY_SIGNATURE = 0x06054b50;
+
+        // Central directory of an archive held in memory, zip64 archives are not read yet
+        bool read_central_directory(BufferView archive, EndOfCentralDirectory& end,
+                                    std::vector<CentralFileHeader>& entries);
+
+        // Append the central directory and the end record to output, which already holds
+        // the local headers and file data the entries point to, false if it needs zip64
+        bool write_central_directory(const std::vector<CentralFileHeader>& entries, Buffer& output);
     }
 
     class ZipFile
     {
     };
+
+    // IMPLEMENTATIONS
+
+    /**
+     * @brief Read the central directory of an archive
+     *
+     * The end record is searched for backwards from the end of the archive, past a
+     * possible archive comment, and the central directory headers are read from the
+     * offset it gives.  Signatures and lengths are checked, local headers are not read.
+     *
+     * @param archive   the whole archive
+     * @param end       the end of central directory record, with its comment
+     * @param entries   replaced by the central directory headers, in stored order
+     *
+     * @return false if the archive is truncated, corrupt or uses zip64
+     */
+    inline bool zip::read_central_directory(BufferView archive, EndOfCentralDirectory& end,
+                                            std::vector<CentralFileHeader>& entries)
+    {
+        entries.clear();
+
+        if (archive.size() < EndOfCentralDirectorySchema::size)
+            return false;
+
+        // the record is the last thing in the file apart from a comment of at most 64 KiB
+        size_t last = archive.size() - EndOfCentralDirectorySchema::size;
+        size_t first = last > 0xffff ? last - 0xffff : 0;
+
+        size_t found = MUSH_DEFAULT_LOC;
+        for (size_t pos = last + 1; pos-- > first;)
+        {
+            if (detail::load<uint32_t>(archive.data() + pos, false) != END_OF_CENTRAL_DIRECTORY_SIGNATURE)
+                continue;
+
+            uint16_t comment_length = detail::load<uint16_t>(archive.data() + pos + 20, false);
+            if (comment_length == last - pos)
+            {
+                found = pos;
+                break;
+            }
+        }
+
+        if (found == MUSH_DEFAULT_LOC)
+            return false;
+
+        BufferView tail = archive.subview(found);
+        tail.read_record<EndOfCentralDirectorySchema>(end);
+        end.zip_file_comment = tail.copy_bytes(end.zip_file_comment_length).to_buffer();
+
+        // zip64 archives keep the real values in their own records
+        if (end.total_number_of_entries == 0xffff || end.size_of_central_directory == 0xffffffff
+                                                   || end.offset_to_disk_number == 0xffffffff)
+            return false;
+
+        if (end.offset_to_disk_number > found || end.size_of_central_directory > found - end.offset_to_disk_number)
+            return false;
+
+        BufferView directory = archive.subview(end.offset_to_disk_number, end.size_of_central_directory);
+        entries.reserve(end.total_number_of_entries);
+
+        for (size_t i = 0; i < end.total_number_of_entries; ++i)
+        {
+            CentralFileHeader entry;
+            if (!directory.read_record<CentralFileHeaderSchema>(entry)
+             || entry.central_file_header_signature != CENTRAL_FILE_HEADER_SIGNATURE
+             || !directory.can_read((size_t)entry.file_name_length + entry.extra_field_length + entry.file_comment_length))
+            {
+                entries.clear();
+                return false;
+            }
+
+            BufferView name = directory.copy_bytes(entry.file_name_length);
+            entry.file_name = std::string((const char*)name.data(), name.size());
+            entry.extra_field = directory.copy_bytes(entry.extra_field_length).to_buffer();
+            entry.file_comment = directory.copy_bytes(entry.file_comment_length).to_buffer();
+
+            entries.push_back(std::move(entry));
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Write the central directory and the end record of an archive
+     *
+     * Signatures and the length fields are filled in from the entries, the rest of each
+     * header is written as given.  The directory starts at the current end of output.
+     *
+     * @param entries   central directory headers of the files in the archive
+     * @param output    the archive so far, the directory and end record are appended
+     *
+     * @return false if the directory does not fit the format without zip64, that is
+     *         65535 or more entries, a name, extra field or comment over 65535 bytes,
+     *         or an archive over 4 GiB.  Nothing is written then.
+     */
+    inline bool zip::write_central_directory(const std::vector<CentralFileHeader>& entries, Buffer& output)
+    {
+        // 0xffff and 0xffffffff mean the real value is in a zip64 record
+        if (entries.size() >= 0xffff)
+            return false;
+
+        size_t start = output.size();
+        size_t size = 0;
+
+        for (const CentralFileHeader& entry : entries)
+        {
+            size_t name_length = entry.file_name.utf8_length();
+            if (name_length > 0xffff || entry.extra_field.size() > 0xffff || entry.file_comment.size() > 0xffff)
+                return false;
+
+            size += CentralFileHeaderSchema::size + name_length + entry.extra_field.size() + entry.file_comment.size();
+        }
+
+        if (start >= 0xffffffff || size >= 0xffffffff - start)
+            return false;
+
+        for (const CentralFileHeader& entry : entries)
+        {
+            CentralFileHeader header = entry;
+            header.central_file_header_signature = CENTRAL_FILE_HEADER_SIGNATURE;
+            header.file_name_length = (uint16_t)entry.file_name.utf8_length();
+            header.extra_field_length = (uint16_t)entry.extra_field.size();
+            header.file_comment_length = (uint16_t)entry.file_comment.size();
+
+            output.write_record<CentralFileHeaderSchema>(header);
+            for (char32_t c : entry.file_name)
+                utf32_to_utf8(c, output);
+            output.write(entry.extra_field);
+            output.write(entry.file_comment);
+        }
+
+        EndOfCentralDirectory end = {};
+        end.signature = END_OF_CENTRAL_DIRECTORY_SIGNATURE;
+        end.total_number_of_entries_this_disk = (uint16_t)entries.size();
+        end.total_number_of_entries = (uint16_t)entries.size();
+        end.size_of_central_directory = (uint32_t)size;
+        end.offset_to_disk_number = (uint32_t)start;
+
+        output.write_record<EndOfCentralDirectorySchema>(end);
+
+        return true;
+    }
 }
+
+#endif